@@ -1,26 +1,62 @@
 #include <shaders.h>
 
 const struct SM_ProgramInfo smProgramInfo[NUM_PROGRAM_KINDS] = {
-        [PROGRAM_arc] = { "arc" },
-        [PROGRAM_circle] = { "circle" },
-        [PROGRAM_line] = { "line" },
-        [PROGRAM_v3] = { "v3" },
+        [PROGRAM_composite] = { "composite", PROGRAM_composite, "", 0 },
+        [PROGRAM_shape] = { "shape", PROGRAM_shape, "", 2 },
+        [PROGRAM_text] = { "text", PROGRAM_text, "", 3 },
+        [PROGRAM_tile] = { "tile", PROGRAM_tile, "", 5 },
+        [PROGRAM_v3] = { "v3", PROGRAM_v3, "#define UNLIT 0\n", 7 },
+        [PROGRAM_v3_UNLIT] = { "v3_UNLIT", PROGRAM_v3, "#define UNLIT 1\n", 9 },
 };
 
 const struct SM_ShaderInfo smShaderInfo[NUM_SHADER_KINDS] = {
 #define SHADER_SOURCE(s) s, sizeof s - 1
-        [SHADER_arc_frag] = { "arc_frag",
+        [SHADER_composite_frag] = { "composite_frag",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
-"in vec2 startPointF;\n"
-"in vec2 centerPointF;\n"
+"// the cached rendering of the committed shapes, see gfx.c\n"
+"uniform sampler2D colorTexture;\n"
+"uniform sampler2D depthTexture;\n"
+"out vec4 fragColor;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	// the textures have the size of the window, so no filtering is needed\n"
+"	ivec2 texel = ivec2(gl_FragCoord.xy);\n"
+"	fragColor = texelFetch(colorTexture, texel, 0);\n"
+"	gl_FragDepth = texelFetch(depthTexture, texel, 0).r;\n"
+"}"), SHADERTYPE_FRAGMENT, "glsl/composite.frag" },
+        [SHADER_composite_vert] = { "composite_vert",
+SHADER_SOURCE(
+"#version 330 core\n"
+"\n"
+"\n"
+"// One triangle that covers the whole screen. gl_VertexID runs from 0 to 2.\n"
+"void main()\n"
+"{\n"
+"	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+"	gl_Position = vec4(2.0 * corner - 1.0, 0, 1);\n"
+"}"), SHADERTYPE_VERTEX, "glsl/composite.vert" },
+        [SHADER_shape_frag] = { "shape_frag",
+SHADER_SOURCE(
+"#version 330 core\n"
+"\n"
+"\n"
+"flat in int kindF;\n"
 "in vec2 positionF;\n"
+"in vec2 pF;\n"
+"in vec2 qF;\n"
 "in vec3 colorF;\n"
-"in float diffAngleF;\n"
 "in float radiusF;\n"
-"flat in int orientationF;\n"
+"in float diffAngleF;\n"
+"out vec4 fragColor;\n"
+"\n"
+"// keep in sync with the SHAPE_ enum in gfx.c\n"
+"const int SHAPE_LINE = 0;\n"
+"const int SHAPE_CIRCLE = 1;\n"
+"const int SHAPE_ARC = 2;\n"
 "\n"
 "int compute_winding_order(vec2 p, vec2 q, vec2 r)\n"
 "{\n"
@@ -36,14 +72,6 @@ SHADER_SOURCE(
 "        return acos(dot(p, q) / (length(p) * length(q)));\n"
 "}\n"
 "\n"
-"float compute_signed_angle(vec2 p, vec2 q)\n"
-"{\n"
-"        float diffAngle = compute_angle(p, q);\n"
-"        if (compute_winding_order(p, vec2(0,0), q) < 0)\n"
-"                diffAngle = -diffAngle;\n"
-"        return diffAngle;\n"
-"}\n"
-"\n"
 "float compute_full_angle(vec2 p, vec2 q)\n"
 "{\n"
 "	float PI = 3.14159265359;\n"
@@ -53,137 +81,208 @@ SHADER_SOURCE(
 "	return angle;\n"
 "}\n"
 "\n"
-"void main()\n"
+"float compute_distance_to_segment(vec2 x, vec2 p, vec2 q)\n"
 "{\n"
-"	float PI = 3.14159265359;\n"
-"	if (distance(positionF, centerPointF) > radiusF)\n"
+"	vec2 d = q - p;\n"
+"	float t = 0.0;\n"
+"	if (dot(d, d) > 0.0)\n"
+"		t = clamp(dot(x - p, d) / dot(d, d), 0.0, 1.0);\n"
+"	return distance(x, p + t * d);\n"
+"}\n"
+"\n"
+"void draw_line()\n"
+"{\n"
+"	// capsule shape: everything within radius of the segment. This gives\n"
+"	// round caps, so consecutive segments of a polyline join seamlessly.\n"
+"	if (compute_distance_to_segment(positionF, pF, qF) > radiusF)\n"
+"		discard;\n"
+"	fragColor = vec4(colorF, 1);\n"
+"}\n"
+"\n"
+"void draw_circle()\n"
+"{\n"
+"	if (distance(positionF, pF) > radiusF)\n"
+"		discard;\n"
+"	fragColor = vec4(colorF, 1);\n"
+"}\n"
+"\n"
+"void draw_arc()\n"
+"{\n"
+"	vec2 startPoint = pF;\n"
+"	vec2 centerPoint = qF;\n"
+"	if (distance(positionF, centerPoint) > radiusF)\n"
 "		discard;\n"
 "	if (diffAngleF < 0.0) {\n"
-"		float angle = -compute_full_angle(positionF - centerPointF, startPointF - centerPointF);\n"
+"		float angle = -compute_full_angle(positionF - centerPoint, startPoint - centerPoint);\n"
 "		if (angle < diffAngleF || angle > 0)\n"
 "			discard;\n"
 "	}\n"
 "	else {\n"
-"		float angle = compute_full_angle(startPointF - centerPointF, positionF - centerPointF);\n"
+"		float angle = compute_full_angle(startPoint - centerPoint, positionF - centerPoint);\n"
 "		if (angle < 0 || angle > diffAngleF)\n"
 "			discard;\n"
 "	}\n"
-"	gl_FragColor = vec4(colorF, 0.5);\n"
-"}"), SHADERTYPE_FRAGMENT},
-        [SHADER_arc_vert] = { "arc_vert",
+"	fragColor = vec4(colorF, 0.5);\n"
+"}\n"
+"\n"
+"void main()\n"
+"{\n"
+"	if (kindF == SHAPE_LINE)\n"
+"		draw_line();\n"
+"	else if (kindF == SHAPE_CIRCLE)\n"
+"		draw_circle();\n"
+"	else\n"
+"		draw_arc();\n"
+"}"), SHADERTYPE_FRAGMENT, "glsl/shape.frag" },
+        [SHADER_shape_vert] = { "shape_vert",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
 "uniform mat4 screenTransform;\n"
 "\n"
-"in vec2 startPoint;\n"
-"in vec2 centerPoint;\n"
-"in vec2 position;\n"
+"in int kind;\n"
+"in vec2 p;\n"
+"in vec2 q;\n"
 "in vec3 color;\n"
-"in float diffAngle;\n"
 "in float radius;\n"
-"in int orientation;\n"
+"in float diffAngle;\n"
 "\n"
-"out vec2 startPointF;\n"
-"out vec2 centerPointF;\n"
+"flat out int kindF;\n"
 "out vec2 positionF;\n"
+"out vec2 pF;\n"
+"out vec2 qF;\n"
 "out vec3 colorF;\n"
-"out float diffAngleF;\n"
 "out float radiusF;\n"
-"flat out int orientationF;\n"
+"out float diffAngleF;\n"
+"\n"
+"// keep in sync with the SHAPE_ enum in gfx.c\n"
+"const int SHAPE_LINE = 0;\n"
+"const int SHAPE_CIRCLE = 1;\n"
+"const int SHAPE_ARC = 2;\n"
+"\n"
+"// Each instance is drawn as a quad made of two triangles. The corners are\n"
+"// in [-1,1]^2 and are selected by gl_VertexID, which runs from 0 to 5.\n"
+"vec2 compute_corner(int vertexID)\n"
+"{\n"
+"	if (vertexID == 0 || vertexID == 5)\n"
+"		return vec2(-1, -1);\n"
+"	if (vertexID == 1)\n"
+"		return vec2(-1, 1);\n"
+"	if (vertexID == 2 || vertexID == 3)\n"
+"		return vec2(1, 1);\n"
+"	return vec2(1, -1);\n"
+"}\n"
 "\n"
 "void main()\n"
 "{\n"
-"	startPointF = startPoint;\n"
-"	centerPointF = centerPoint;\n"
+"	vec2 corner = compute_corner(gl_VertexID);\n"
+"	vec2 position;\n"
+"	if (kind == SHAPE_LINE) {\n"
+"		// p and q are the end points, radius is half the line width.\n"
+"		// The quad is extended by the radius beyond each end point to\n"
+"		// make room for the round caps that are cut out in shape.frag.\n"
+"		vec2 d = q - p;\n"
+"		vec2 direction = vec2(1, 0);\n"
+"		if (length(d) > 0.0)\n"
+"			direction = normalize(d);\n"
+"		vec2 normal = vec2(direction.y, -direction.x);\n"
+"		position = mix(p, q, 0.5 * (corner.x + 1.0))\n"
+"			+ corner.x * radius * direction\n"
+"			+ corner.y * radius * normal;\n"
+"	}\n"
+"	else if (kind == SHAPE_CIRCLE) {\n"
+"		// p is the center point\n"
+"		position = p + radius * corner;\n"
+"	}\n"
+"	else {\n"
+"		// p is the start point, q is the center point\n"
+"		position = q + radius * corner;\n"
+"	}\n"
+"	kindF = kind;\n"
 "	positionF = position;\n"
+"	pF = p;\n"
+"	qF = q;\n"
 "	colorF = color;\n"
-"	diffAngleF = diffAngle;\n"
 "	radiusF = radius;\n"
-"	orientationF = orientation;\n"
+"	diffAngleF = diffAngle;\n"
 "	gl_Position = screenTransform * vec4(position, 0, 1);\n"
-"}"), SHADERTYPE_VERTEX},
-        [SHADER_circle_frag] = { "circle_frag",
+"}"), SHADERTYPE_VERTEX, "glsl/shape.vert" },
+        [SHADER_text_frag] = { "text_frag",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
-"in vec2 diffF;\n"
-"in vec3 colorF;\n"
-"in float radiusF;\n"
+"// one channel, the coverage of the glyphs\n"
+"uniform sampler2D fontTexture;\n"
+"\n"
+"in vec2 texCoordF;\n"
+"in vec4 colorF;\n"
+"out vec4 fragColor;\n"
 "\n"
 "void main()\n"
 "{\n"
-"	float d = length(diffF);\n"
-"	if (d <= radiusF)\n"
-"		gl_FragColor = vec4(colorF, 1);\n"
-"	else\n"
-"		discard;\n"
-"}"), SHADERTYPE_FRAGMENT},
-        [SHADER_circle_vert] = { "circle_vert",
+"	fragColor = vec4(colorF.rgb, colorF.a * texture(fontTexture, texCoordF).r);\n"
+"}"), SHADERTYPE_FRAGMENT, "glsl/text.frag" },
+        [SHADER_text_vert] = { "text_vert",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
-"uniform mat4 screenTransform;\n"
+"uniform vec2 screenSize;  // in pixels\n"
 "\n"
-"in vec2 centerPoint;\n"
-"in vec2 diff;\n"
-"in vec3 color;\n"
-"in float radius;\n"
+"in vec2 position;  // in pixels from the top left\n"
+"in vec2 texCoord;  // in the font atlas\n"
+"in vec4 color;\n"
 "\n"
-"out vec2 diffF;\n"
-"out vec3 colorF;\n"
-"out float radiusF;\n"
+"out vec2 texCoordF;\n"
+"out vec4 colorF;\n"
 "\n"
 "void main()\n"
 "{\n"
-"	diffF = radius * diff;\n"
+"	texCoordF = texCoord;\n"
 "	colorF = color;\n"
-"	radiusF = radius;\n"
-"	vec2 position = centerPoint + radius * diff;\n"
-"	gl_Position = screenTransform * vec4(position, 0, 1);\n"
-"}"), SHADERTYPE_VERTEX},
-        [SHADER_line_frag] = { "line_frag",
+"	vec2 p = 2.0 * position / screenSize - 1.0;\n"
+"	gl_Position = vec4(p.x, -p.y, 0, 1);\n"
+"}"), SHADERTYPE_VERTEX, "glsl/text.vert" },
+        [SHADER_tile_frag] = { "tile_frag",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
-"in vec2 positionF;\n"
-"in vec2 normalF;\n"
-"in vec3 colorF;\n"
+"uniform sampler2D atlasTexture;\n"
+"\n"
+"in vec2 texCoordF;\n"
+"out vec4 fragColor;\n"
 "\n"
 "void main()\n"
 "{\n"
-"	float w = length(fwidth(positionF));\n"
-"	gl_FragColor = vec4(colorF, 1);\n"
-"}"), SHADERTYPE_FRAGMENT},
-        [SHADER_line_vert] = { "line_vert",
+"	vec4 color = texture(atlasTexture, texCoordF);\n"
+"	// nothing was drawn here, so don't occlude anything either\n"
+"	if (color.a == 0.0)\n"
+"		discard;\n"
+"	fragColor = color;\n"
+"}"), SHADERTYPE_FRAGMENT, "glsl/tile.frag" },
+        [SHADER_tile_vert] = { "tile_vert",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
 "uniform mat4 screenTransform;\n"
 "\n"
-"in vec2 position;\n"
-"in vec2 normal;\n"
-"in vec3 color;\n"
+"in vec2 position;  // in the plane of the 2D shapes\n"
+"in vec2 texCoord;  // in the tile atlas\n"
 "\n"
-"out vec2 positionF;\n"
-"out vec2 normalF;\n"
-"out vec3 colorF;\n"
+"out vec2 texCoordF;\n"
 "\n"
 "void main()\n"
 "{\n"
-"	positionF = position;\n"
-"	normalF = normal;\n"
-"	colorF = color;\n"
-"	gl_Position = screenTransform * vec4(position + normal, 0, 1);\n"
-"}"), SHADERTYPE_VERTEX},
+"	texCoordF = texCoord;\n"
+"	gl_Position = screenTransform * vec4(position, 0, 1);\n"
+"}"), SHADERTYPE_VERTEX, "glsl/tile.vert" },
         [SHADER_v3_frag] = { "v3_frag",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "/*HELLO*/\n"
 "uniform mat4 test;\n"
 "\n"
@@ -192,6 +291,7 @@ SHADER_SOURCE(
 "in vec3 positionF;\n"
 "in vec3 normalF;\n"
 "in vec3 colorF;\n"
+"out vec4 fragColor;\n"
 "\n"
 "float compute_specular_strength(vec3 lightPos, vec3 surfacePoint, vec3 normalizedSurfaceNormal, vec3 spectatorPosition) {\n"
 "	vec3 lightToSurface = surfacePoint - lightPos;\n"
@@ -219,12 +319,14 @@ SHADER_SOURCE(
 "	float lightIntensity = 0.5 + diffuseStrength;\n"
 "	if (lightIntensity < 0) lightIntensity = 0;\n"
 "	if (lightIntensity > 1) lightIntensity = 1;\n"
-"	gl_FragColor = vec4(lightIntensity * colorF, 1);\n"
-"	//gl_FragColor = vec4(positionF, 1);\n"
-"}"), SHADERTYPE_FRAGMENT},
+"	// UNLIT is a variant axis (see process-shaders)\n"
+"	if (UNLIT != 0) lightIntensity = 1;\n"
+"	fragColor = vec4(lightIntensity * colorF, 1);\n"
+"	//fragColor = vec4(positionF, 1);\n"
+"}"), SHADERTYPE_FRAGMENT, "glsl/v3.frag" },
         [SHADER_v3_vert] = { "v3_vert",
 SHADER_SOURCE(
-"#version 130\n"
+"#version 330 core\n"
 "\n"
 "\n"
 "uniform mat4 screenTransform;\n"
@@ -243,16 +345,18 @@ SHADER_SOURCE(
 "	colorF = color;\n"
 "	normalF = normal;\n"
 "	gl_Position = screenTransform * vec4(position, 1);\n"
-"}"), SHADERTYPE_VERTEX},
+"}"), SHADERTYPE_VERTEX, "glsl/v3.vert" },
 };
 
 const struct SM_LinkInfo smLinkInfo[] = {
-        { PROGRAM_arc, SHADER_arc_frag },
-        { PROGRAM_arc, SHADER_arc_vert },
-        { PROGRAM_circle, SHADER_circle_frag },
-        { PROGRAM_circle, SHADER_circle_vert },
-        { PROGRAM_line, SHADER_line_frag },
-        { PROGRAM_line, SHADER_line_vert },
+        { PROGRAM_composite, SHADER_composite_frag },
+        { PROGRAM_composite, SHADER_composite_vert },
+        { PROGRAM_shape, SHADER_shape_frag },
+        { PROGRAM_shape, SHADER_shape_vert },
+        { PROGRAM_text, SHADER_text_frag },
+        { PROGRAM_text, SHADER_text_vert },
+        { PROGRAM_tile, SHADER_tile_frag },
+        { PROGRAM_tile, SHADER_tile_vert },
         { PROGRAM_v3, SHADER_v3_frag },
         { PROGRAM_v3, SHADER_v3_vert },
 };
@@ -260,37 +364,36 @@ const struct SM_LinkInfo smLinkInfo[] = {
 const int numLinkInfos = sizeof smLinkInfo / sizeof smLinkInfo[0];
 
 const struct SM_UniformInfo smUniformInfo[NUM_UNIFORM_KINDS] = {
-        [UNIFORM_arc_screenTransform] = { PROGRAM_arc, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
-        [UNIFORM_circle_screenTransform] = { PROGRAM_circle, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
-        [UNIFORM_line_screenTransform] = { PROGRAM_line, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
+        [UNIFORM_composite_colorTexture] = { PROGRAM_composite, GRAFIKUNIFORMTYPE_SAMPLER2D, "colorTexture" },
+        [UNIFORM_composite_depthTexture] = { PROGRAM_composite, GRAFIKUNIFORMTYPE_SAMPLER2D, "depthTexture" },
+        [UNIFORM_shape_screenTransform] = { PROGRAM_shape, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
+        [UNIFORM_text_fontTexture] = { PROGRAM_text, GRAFIKUNIFORMTYPE_SAMPLER2D, "fontTexture" },
+        [UNIFORM_text_screenSize] = { PROGRAM_text, GRAFIKUNIFORMTYPE_VEC2, "screenSize" },
+        [UNIFORM_tile_atlasTexture] = { PROGRAM_tile, GRAFIKUNIFORMTYPE_SAMPLER2D, "atlasTexture" },
+        [UNIFORM_tile_screenTransform] = { PROGRAM_tile, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
         [UNIFORM_v3_screenTransform] = { PROGRAM_v3, GRAFIKUNIFORMTYPE_MAT4, "screenTransform" },
         [UNIFORM_v3_test] = { PROGRAM_v3, GRAFIKUNIFORMTYPE_MAT4, "test" },
 };
 
 const struct SM_AttributeInfo smAttributeInfo[NUM_ATTRIBUTE_KINDS] = {
-        [ATTRIBUTE_arc_centerPoint] = { PROGRAM_arc, GRAFIKATTRTYPE_VEC2, "centerPoint" },
-        [ATTRIBUTE_arc_color] = { PROGRAM_arc, GRAFIKATTRTYPE_VEC3, "color" },
-        [ATTRIBUTE_arc_diffAngle] = { PROGRAM_arc, GRAFIKATTRTYPE_FLOAT, "diffAngle" },
-        [ATTRIBUTE_arc_orientation] = { PROGRAM_arc, GRAFIKATTRTYPE_INT, "orientation" },
-        [ATTRIBUTE_arc_position] = { PROGRAM_arc, GRAFIKATTRTYPE_VEC2, "position" },
-        [ATTRIBUTE_arc_radius] = { PROGRAM_arc, GRAFIKATTRTYPE_FLOAT, "radius" },
-        [ATTRIBUTE_arc_startPoint] = { PROGRAM_arc, GRAFIKATTRTYPE_VEC2, "startPoint" },
-        [ATTRIBUTE_circle_centerPoint] = { PROGRAM_circle, GRAFIKATTRTYPE_VEC2, "centerPoint" },
-        [ATTRIBUTE_circle_color] = { PROGRAM_circle, GRAFIKATTRTYPE_VEC3, "color" },
-        [ATTRIBUTE_circle_diff] = { PROGRAM_circle, GRAFIKATTRTYPE_VEC2, "diff" },
-        [ATTRIBUTE_circle_radius] = { PROGRAM_circle, GRAFIKATTRTYPE_FLOAT, "radius" },
-        [ATTRIBUTE_line_color] = { PROGRAM_line, GRAFIKATTRTYPE_VEC3, "color" },
-        [ATTRIBUTE_line_normal] = { PROGRAM_line, GRAFIKATTRTYPE_VEC2, "normal" },
-        [ATTRIBUTE_line_position] = { PROGRAM_line, GRAFIKATTRTYPE_VEC2, "position" },
-        [ATTRIBUTE_v3_color] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "color" },
-        [ATTRIBUTE_v3_normal] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "normal" },
-        [ATTRIBUTE_v3_position] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "position" },
+        [ATTRIBUTE_shape_color] = { PROGRAM_shape, GRAFIKATTRTYPE_VEC3, "color", ATTRIBLOCATION_shape_color },
+        [ATTRIBUTE_shape_diffAngle] = { PROGRAM_shape, GRAFIKATTRTYPE_FLOAT, "diffAngle", ATTRIBLOCATION_shape_diffAngle },
+        [ATTRIBUTE_shape_kind] = { PROGRAM_shape, GRAFIKATTRTYPE_INT, "kind", ATTRIBLOCATION_shape_kind },
+        [ATTRIBUTE_shape_p] = { PROGRAM_shape, GRAFIKATTRTYPE_VEC2, "p", ATTRIBLOCATION_shape_p },
+        [ATTRIBUTE_shape_q] = { PROGRAM_shape, GRAFIKATTRTYPE_VEC2, "q", ATTRIBLOCATION_shape_q },
+        [ATTRIBUTE_shape_radius] = { PROGRAM_shape, GRAFIKATTRTYPE_FLOAT, "radius", ATTRIBLOCATION_shape_radius },
+        [ATTRIBUTE_text_color] = { PROGRAM_text, GRAFIKATTRTYPE_VEC4, "color", ATTRIBLOCATION_text_color },
+        [ATTRIBUTE_text_position] = { PROGRAM_text, GRAFIKATTRTYPE_VEC2, "position", ATTRIBLOCATION_text_position },
+        [ATTRIBUTE_text_texCoord] = { PROGRAM_text, GRAFIKATTRTYPE_VEC2, "texCoord", ATTRIBLOCATION_text_texCoord },
+        [ATTRIBUTE_tile_position] = { PROGRAM_tile, GRAFIKATTRTYPE_VEC2, "position", ATTRIBLOCATION_tile_position },
+        [ATTRIBUTE_tile_texCoord] = { PROGRAM_tile, GRAFIKATTRTYPE_VEC2, "texCoord", ATTRIBLOCATION_tile_texCoord },
+        [ATTRIBUTE_v3_color] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "color", ATTRIBLOCATION_v3_color },
+        [ATTRIBUTE_v3_normal] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "normal", ATTRIBLOCATION_v3_normal },
+        [ATTRIBUTE_v3_position] = { PROGRAM_v3, GRAFIKATTRTYPE_VEC3, "position", ATTRIBLOCATION_v3_position },
 };
 
 GfxProgram gfxProgram[NUM_PROGRAM_KINDS];
-GfxShader gfxShader[NUM_SHADER_KINDS];
-GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_KINDS];
-GfxAttributeLocation gfxAttributeLocation[NUM_ATTRIBUTE_KINDS];
+GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_LOCATIONS];
 
 const struct SM_Description smDescription = {
         .programInfo = smProgramInfo,
@@ -300,9 +403,7 @@ const struct SM_Description smDescription = {
         .attributeInfo = smAttributeInfo,
 
         .gfxProgram = gfxProgram,
-        .gfxShader = gfxShader,
         .gfxUniformLocation = gfxUniformLocation,
-        .gfxAttributeLocation = gfxAttributeLocation,
 
         .numPrograms = NUM_PROGRAM_KINDS,
         .numShaders = NUM_SHADER_KINDS,
@@ -311,3 +412,33 @@ const struct SM_Description smDescription = {
         .numLinks = sizeof smLinkInfo / sizeof smLinkInfo[0],
 };
 
+void setup_shape_vao(GfxVAO vao, GfxVBO vbo)
+{
+        SET_ATTRIBPOINTER_shape_p(vao, vbo, struct shapeVertex, p);
+        SET_ATTRIBPOINTER_shape_q(vao, vbo, struct shapeVertex, q);
+        SET_ATTRIBPOINTER_shape_diffAngle(vao, vbo, struct shapeVertex, diffAngle);
+        SET_ATTRIBPOINTER_shape_radius(vao, vbo, struct shapeVertex, radius);
+        SET_PACKED_ATTRIBPOINTER_shape_color(vao, vbo, struct shapeVertex, color, ATTRIBFORMAT_UNORM8);
+        SET_PACKED_ATTRIBPOINTER_shape_kind(vao, vbo, struct shapeVertex, kind, ATTRIBFORMAT_UINT8);
+}
+
+void setup_text_vao(GfxVAO vao, GfxVBO vbo)
+{
+        SET_ATTRIBPOINTER_text_position(vao, vbo, struct textVertex, position);
+        SET_ATTRIBPOINTER_text_texCoord(vao, vbo, struct textVertex, texCoord);
+        SET_PACKED_ATTRIBPOINTER_text_color(vao, vbo, struct textVertex, color, ATTRIBFORMAT_UNORM8);
+}
+
+void setup_tile_vao(GfxVAO vao, GfxVBO vbo)
+{
+        SET_ATTRIBPOINTER_tile_position(vao, vbo, struct tileVertex, position);
+        SET_ATTRIBPOINTER_tile_texCoord(vao, vbo, struct tileVertex, texCoord);
+}
+
+void setup_v3_vao(GfxVAO vao, GfxVBO vbo)
+{
+        SET_PACKED_ATTRIBPOINTER_v3_normal(vao, vbo, struct v3Vertex, normal, ATTRIBFORMAT_SNORM_2_10_10_10_REV);
+        SET_PACKED_ATTRIBPOINTER_v3_position(vao, vbo, struct v3Vertex, position, ATTRIBFORMAT_SNORM16);
+        SET_PACKED_ATTRIBPOINTER_v3_color(vao, vbo, struct v3Vertex, color, ATTRIBFORMAT_UNORM8);
+}
+
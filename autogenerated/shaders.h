@@ -2,61 +2,93 @@
 #define AUTOGENERATED_SHADERS_H_INCLUDED
 
 #include <segments/gfx.h>
+#include <stddef.h>  // offsetof()
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 enum {
-        PROGRAM_arc,
-        PROGRAM_circle,
-        PROGRAM_line,
+        PROGRAM_composite,
+        PROGRAM_shape,
+        PROGRAM_text,
+        PROGRAM_tile,
         PROGRAM_v3,
+        PROGRAM_v3_UNLIT,
         NUM_PROGRAM_KINDS,
 };
 
+// PROGRAM_x + VARIANTBIT_x_A + VARIANTBIT_x_B == PROGRAM_x_A_B
 enum {
-        SHADER_arc_frag,
-        SHADER_arc_vert,
-        SHADER_circle_frag,
-        SHADER_circle_vert,
-        SHADER_line_frag,
-        SHADER_line_vert,
+        VARIANTBIT_v3_UNLIT = 1,
+};
+
+enum {
+        SHADER_composite_frag,
+        SHADER_composite_vert,
+        SHADER_shape_frag,
+        SHADER_shape_vert,
+        SHADER_text_frag,
+        SHADER_text_vert,
+        SHADER_tile_frag,
+        SHADER_tile_vert,
         SHADER_v3_frag,
         SHADER_v3_vert,
         NUM_SHADER_KINDS,
 };
 
 enum {
-        UNIFORM_arc_screenTransform,
-        UNIFORM_circle_screenTransform,
-        UNIFORM_line_screenTransform,
+        UNIFORM_composite_colorTexture,
+        UNIFORM_composite_depthTexture,
+        UNIFORM_shape_screenTransform,
+        UNIFORM_text_fontTexture,
+        UNIFORM_text_screenSize,
+        UNIFORM_tile_atlasTexture,
+        UNIFORM_tile_screenTransform,
         UNIFORM_v3_screenTransform,
         UNIFORM_v3_test,
         NUM_UNIFORM_KINDS,
 };
 
 enum {
-        ATTRIBUTE_arc_centerPoint,
-        ATTRIBUTE_arc_color,
-        ATTRIBUTE_arc_diffAngle,
-        ATTRIBUTE_arc_orientation,
-        ATTRIBUTE_arc_position,
-        ATTRIBUTE_arc_radius,
-        ATTRIBUTE_arc_startPoint,
-        ATTRIBUTE_circle_centerPoint,
-        ATTRIBUTE_circle_color,
-        ATTRIBUTE_circle_diff,
-        ATTRIBUTE_circle_radius,
-        ATTRIBUTE_line_color,
-        ATTRIBUTE_line_normal,
-        ATTRIBUTE_line_position,
+        NUM_UNIFORM_LOCATIONS = 11,
+};
+
+enum {
+        ATTRIBUTE_shape_color,
+        ATTRIBUTE_shape_diffAngle,
+        ATTRIBUTE_shape_kind,
+        ATTRIBUTE_shape_p,
+        ATTRIBUTE_shape_q,
+        ATTRIBUTE_shape_radius,
+        ATTRIBUTE_text_color,
+        ATTRIBUTE_text_position,
+        ATTRIBUTE_text_texCoord,
+        ATTRIBUTE_tile_position,
+        ATTRIBUTE_tile_texCoord,
         ATTRIBUTE_v3_color,
         ATTRIBUTE_v3_normal,
         ATTRIBUTE_v3_position,
         NUM_ATTRIBUTE_KINDS,
 };
 
+enum {
+        ATTRIBLOCATION_shape_color = 0,
+        ATTRIBLOCATION_shape_diffAngle = 1,
+        ATTRIBLOCATION_shape_kind = 2,
+        ATTRIBLOCATION_shape_p = 3,
+        ATTRIBLOCATION_shape_q = 4,
+        ATTRIBLOCATION_shape_radius = 5,
+        ATTRIBLOCATION_text_color = 0,
+        ATTRIBLOCATION_text_position = 1,
+        ATTRIBLOCATION_text_texCoord = 2,
+        ATTRIBLOCATION_tile_position = 0,
+        ATTRIBLOCATION_tile_texCoord = 1,
+        ATTRIBLOCATION_v3_color = 0,
+        ATTRIBLOCATION_v3_normal = 1,
+        ATTRIBLOCATION_v3_position = 2,
+};
+
 extern const struct SM_ShaderInfo smShaderInfo[NUM_SHADER_KINDS];
 extern const struct SM_ProgramInfo smProgramInfo[NUM_PROGRAM_KINDS];
 extern const struct SM_LinkInfo smLinkInfo[];
@@ -65,16 +97,18 @@ extern const struct SM_UniformInfo smUniformInfo[NUM_UNIFORM_KINDS];
 extern const struct SM_AttributeInfo smAttributeInfo[NUM_ATTRIBUTE_KINDS];
 extern const struct SM_Description smDescription;
 
-extern GfxShader gfxShader[NUM_SHADER_KINDS];
 extern GfxProgram gfxProgram[NUM_PROGRAM_KINDS];
-extern GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_KINDS];
-extern GfxAttributeLocation gfxAttributeLocation[NUM_ATTRIBUTE_KINDS];
+extern GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_LOCATIONS];
 
-static inline void arcShader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_arc], gfxUniformLocation[UNIFORM_arc_screenTransform], mat); }
-static inline void circleShader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_circle], gfxUniformLocation[UNIFORM_circle_screenTransform], mat); }
-static inline void lineShader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_line], gfxUniformLocation[UNIFORM_line_screenTransform], mat); }
-static inline void v3Shader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_v3], gfxUniformLocation[UNIFORM_v3_screenTransform], mat); }
-static inline void v3Shader_set_test(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_v3], gfxUniformLocation[UNIFORM_v3_test], mat); }
+static inline void compositeShader_set_colorTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_composite], gfxUniformLocation[UNIFORM_composite_colorTexture], textureUnit); }
+static inline void compositeShader_set_depthTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_composite], gfxUniformLocation[UNIFORM_composite_depthTexture], textureUnit); }
+static inline void shapeShader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_shape], gfxUniformLocation[UNIFORM_shape_screenTransform], mat); }
+static inline void textShader_set_fontTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_text], gfxUniformLocation[UNIFORM_text_fontTexture], textureUnit); }
+static inline void textShader_set_screenSize(float x, float y) { set_uniform_2f(gfxProgram[PROGRAM_text], gfxUniformLocation[UNIFORM_text_screenSize], x, y); }
+static inline void tileShader_set_atlasTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_tile], gfxUniformLocation[UNIFORM_tile_atlasTexture], textureUnit); }
+static inline void tileShader_set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_tile], gfxUniformLocation[UNIFORM_tile_screenTransform], mat); }
+static inline void v3Shader_set_screenTransform(int programIndex, const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[programIndex], gfxUniformLocation[smProgramInfo[programIndex].firstUniformLocation + UNIFORM_v3_screenTransform - smProgramInfo[PROGRAM_v3].firstUniformLocation], mat); }
+static inline void v3Shader_set_test(int programIndex, const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[programIndex], gfxUniformLocation[smProgramInfo[programIndex].firstUniformLocation + UNIFORM_v3_test - smProgramInfo[PROGRAM_v3].firstUniformLocation], mat); }
 
 
 #define SET_TYPED_ATTRIBPOINTER(attribKind, vao, vbo, structType, memberName, type) do {\
@@ -82,42 +116,98 @@ static inline void v3Shader_set_test(const struct Mat4 *mat) { set_uniform_mat4f
         set_attribpointer((attribKind), (vao), (vbo), sizeof (structType), offsetof(structType, memberName));\
 } while (0)
 
-#define SET_ATTRIBPOINTER_arc_centerPoint(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_centerPoint, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_arc_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_color, (vao), (vbo), structType, memberName, struct Vec3)
-#define SET_ATTRIBPOINTER_arc_diffAngle(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_diffAngle, (vao), (vbo), structType, memberName, float)
-#define SET_ATTRIBPOINTER_arc_orientation(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_orientation, (vao), (vbo), structType, memberName, int)
-#define SET_ATTRIBPOINTER_arc_position(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_position, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_arc_radius(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_radius, (vao), (vbo), structType, memberName, float)
-#define SET_ATTRIBPOINTER_arc_startPoint(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_arc_startPoint, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_circle_centerPoint(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_circle_centerPoint, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_circle_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_circle_color, (vao), (vbo), structType, memberName, struct Vec3)
-#define SET_ATTRIBPOINTER_circle_diff(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_circle_diff, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_circle_radius(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_circle_radius, (vao), (vbo), structType, memberName, float)
-#define SET_ATTRIBPOINTER_line_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_line_color, (vao), (vbo), structType, memberName, struct Vec3)
-#define SET_ATTRIBPOINTER_line_normal(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_line_normal, (vao), (vbo), structType, memberName, struct Vec2)
-#define SET_ATTRIBPOINTER_line_position(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_line_position, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_shape_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_color, (vao), (vbo), structType, memberName, struct Vec3)
+#define SET_ATTRIBPOINTER_shape_diffAngle(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_diffAngle, (vao), (vbo), structType, memberName, float)
+#define SET_ATTRIBPOINTER_shape_kind(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_kind, (vao), (vbo), structType, memberName, int)
+#define SET_ATTRIBPOINTER_shape_p(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_p, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_shape_q(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_q, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_shape_radius(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_shape_radius, (vao), (vbo), structType, memberName, float)
+#define SET_ATTRIBPOINTER_text_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_text_color, (vao), (vbo), structType, memberName, struct Vec4)
+#define SET_ATTRIBPOINTER_text_position(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_text_position, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_text_texCoord(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_text_texCoord, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_tile_position(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_tile_position, (vao), (vbo), structType, memberName, struct Vec2)
+#define SET_ATTRIBPOINTER_tile_texCoord(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_tile_texCoord, (vao), (vbo), structType, memberName, struct Vec2)
 #define SET_ATTRIBPOINTER_v3_color(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_v3_color, (vao), (vbo), structType, memberName, struct Vec3)
 #define SET_ATTRIBPOINTER_v3_normal(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_v3_normal, (vao), (vbo), structType, memberName, struct Vec3)
 #define SET_ATTRIBPOINTER_v3_position(vao, vbo, structType, memberName) SET_TYPED_ATTRIBPOINTER(ATTRIBUTE_v3_position, (vao), (vbo), structType, memberName, struct Vec3)
 
+#define SET_PACKED_ATTRIBPOINTER(attribKind, attribformatKind, vao, vbo, structType, memberName) \
+        set_packed_attribpointer((attribKind), (attribformatKind), (vao), (vbo), sizeof (structType), offsetof(structType, memberName), sizeof ((structType *)NULL)->memberName)
+
+#define SET_PACKED_ATTRIBPOINTER_shape_color(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_color, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_shape_diffAngle(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_diffAngle, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_shape_kind(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_kind, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_shape_p(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_p, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_shape_q(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_q, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_shape_radius(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_shape_radius, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_text_color(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_text_color, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_text_position(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_text_position, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_text_texCoord(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_text_texCoord, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_tile_position(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_tile_position, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_tile_texCoord(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_tile_texCoord, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_v3_color(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_v3_color, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_v3_normal(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_v3_normal, (attribformatKind), (vao), (vbo), structType, memberName)
+#define SET_PACKED_ATTRIBPOINTER_v3_position(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_v3_position, (attribformatKind), (vao), (vbo), structType, memberName)
+
+struct shapeVertex {
+        struct Vec2 p;  // offset 0
+        struct Vec2 q;  // offset 8
+        float diffAngle;  // offset 16
+        float radius;  // offset 20
+        struct Unorm8Vec4 color;  // offset 24
+        unsigned char kind;  // offset 28
+};
+typedef char shapeVertex_CHECK_SIZE[sizeof (struct shapeVertex) == 32 ? 1 : -1];
+void setup_shape_vao(GfxVAO vao, GfxVBO vbo);
+
+struct textVertex {
+        struct Vec2 position;  // offset 0
+        struct Vec2 texCoord;  // offset 8
+        struct Unorm8Vec4 color;  // offset 16
+};
+typedef char textVertex_CHECK_SIZE[sizeof (struct textVertex) == 20 ? 1 : -1];
+void setup_text_vao(GfxVAO vao, GfxVBO vbo);
+
+struct tileVertex {
+        struct Vec2 position;  // offset 0
+        struct Vec2 texCoord;  // offset 8
+};
+typedef char tileVertex_CHECK_SIZE[sizeof (struct tileVertex) == 16 ? 1 : -1];
+void setup_tile_vao(GfxVAO vao, GfxVBO vbo);
+
+struct v3Vertex {
+        Snorm_2_10_10_10_Rev normal;  // offset 0
+        struct Snorm16Vec3 position;  // offset 4
+        struct Unorm8Vec4 color;  // offset 12
+};
+typedef char v3Vertex_CHECK_SIZE[sizeof (struct v3Vertex) == 16 ? 1 : -1];
+void setup_v3_vao(GfxVAO vao, GfxVBO vbo);
+
 
 #ifdef __cplusplus
 
 static struct {
-        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_arc], gfxUniformLocation[UNIFORM_arc_screenTransform], &mat->mat[0][0]); }
-} arcShader;
+        static inline void set_colorTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_composite], gfxUniformLocation[UNIFORM_composite_colorTexture], textureUnit); }
+        static inline void set_depthTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_composite], gfxUniformLocation[UNIFORM_composite_depthTexture], textureUnit); }
+} compositeShader;
+
+static struct {
+        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_shape], gfxUniformLocation[UNIFORM_shape_screenTransform], mat); }
+} shapeShader;
 
 static struct {
-        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_circle], gfxUniformLocation[UNIFORM_circle_screenTransform], &mat->mat[0][0]); }
-} circleShader;
+        static inline void set_fontTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_text], gfxUniformLocation[UNIFORM_text_fontTexture], textureUnit); }
+        static inline void set_screenSize(float x, float y) { set_uniform_2f(gfxProgram[PROGRAM_text], gfxUniformLocation[UNIFORM_text_screenSize], x, y); }
+} textShader;
 
 static struct {
-        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_line], gfxUniformLocation[UNIFORM_line_screenTransform], &mat->mat[0][0]); }
-} lineShader;
+        static inline void set_atlasTexture(int textureUnit) { set_uniform_1i(gfxProgram[PROGRAM_tile], gfxUniformLocation[UNIFORM_tile_atlasTexture], textureUnit); }
+        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_tile], gfxUniformLocation[UNIFORM_tile_screenTransform], mat); }
+} tileShader;
 
 static struct {
-        static inline void set_screenTransform(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_v3], gfxUniformLocation[UNIFORM_v3_screenTransform], &mat->mat[0][0]); }
-        static inline void set_test(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_v3], gfxUniformLocation[UNIFORM_v3_test], &mat->mat[0][0]); }
+        static inline void set_screenTransform(int programIndex, const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[programIndex], gfxUniformLocation[smProgramInfo[programIndex].firstUniformLocation + UNIFORM_v3_screenTransform - smProgramInfo[PROGRAM_v3].firstUniformLocation], mat); }
+        static inline void set_test(int programIndex, const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[programIndex], gfxUniformLocation[smProgramInfo[programIndex].firstUniformLocation + UNIFORM_v3_test - smProgramInfo[PROGRAM_v3].firstUniformLocation], mat); }
 } v3Shader;
 
 #endif // #ifdef __cplusplus
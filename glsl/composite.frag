@@ -0,0 +1,14 @@
+#version 330 core
+
+// the cached rendering of the committed shapes, see gfx.c
+uniform sampler2D colorTexture;
+uniform sampler2D depthTexture;
+out vec4 fragColor;
+
+void main()
+{
+	// the textures have the size of the window, so no filtering is needed
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	fragColor = texelFetch(colorTexture, texel, 0);
+	gl_FragDepth = texelFetch(depthTexture, texel, 0).r;
+}
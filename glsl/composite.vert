@@ -0,0 +1,8 @@
+#version 330 core
+
+// One triangle that covers the whole screen. gl_VertexID runs from 0 to 2.
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(2.0 * corner - 1.0, 0, 1);
+}
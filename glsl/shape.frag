@@ -0,0 +1,92 @@
+#version 330 core
+
+flat in int kindF;
+in vec2 positionF;
+in vec2 pF;
+in vec2 qF;
+in vec3 colorF;
+in float radiusF;
+in float diffAngleF;
+out vec4 fragColor;
+
+// keep in sync with the SHAPE_ enum in gfx.c
+const int SHAPE_LINE = 0;
+const int SHAPE_CIRCLE = 1;
+const int SHAPE_ARC = 2;
+
+int compute_winding_order(vec2 p, vec2 q, vec2 r)
+{
+        float area = 0.0;
+        area += (q.x - p.x) * (q.y + p.y);
+        area += (r.x - q.x) * (r.y + q.y);
+        area += (p.x - r.x) * (p.y + r.y);
+        return int(area > 0) - int(area < 0);
+}
+
+float compute_angle(vec2 p, vec2 q)
+{
+        return acos(dot(p, q) / (length(p) * length(q)));
+}
+
+float compute_full_angle(vec2 p, vec2 q)
+{
+	float PI = 3.14159265359;
+	float angle = compute_angle(p, q);
+	if (compute_winding_order(p, vec2(0, 0), q) == -1)
+		angle = 2 * PI - angle;
+	return angle;
+}
+
+float compute_distance_to_segment(vec2 x, vec2 p, vec2 q)
+{
+	vec2 d = q - p;
+	float t = 0.0;
+	if (dot(d, d) > 0.0)
+		t = clamp(dot(x - p, d) / dot(d, d), 0.0, 1.0);
+	return distance(x, p + t * d);
+}
+
+void draw_line()
+{
+	// capsule shape: everything within radius of the segment. This gives
+	// round caps, so consecutive segments of a polyline join seamlessly.
+	if (compute_distance_to_segment(positionF, pF, qF) > radiusF)
+		discard;
+	fragColor = vec4(colorF, 1);
+}
+
+void draw_circle()
+{
+	if (distance(positionF, pF) > radiusF)
+		discard;
+	fragColor = vec4(colorF, 1);
+}
+
+void draw_arc()
+{
+	vec2 startPoint = pF;
+	vec2 centerPoint = qF;
+	if (distance(positionF, centerPoint) > radiusF)
+		discard;
+	if (diffAngleF < 0.0) {
+		float angle = -compute_full_angle(positionF - centerPoint, startPoint - centerPoint);
+		if (angle < diffAngleF || angle > 0)
+			discard;
+	}
+	else {
+		float angle = compute_full_angle(startPoint - centerPoint, positionF - centerPoint);
+		if (angle < 0 || angle > diffAngleF)
+			discard;
+	}
+	fragColor = vec4(colorF, 0.5);
+}
+
+void main()
+{
+	if (kindF == SHAPE_LINE)
+		draw_line();
+	else if (kindF == SHAPE_CIRCLE)
+		draw_circle();
+	else
+		draw_arc();
+}
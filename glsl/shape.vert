@@ -0,0 +1,71 @@
+#version 330 core
+
+uniform mat4 screenTransform;
+
+in int kind;
+in vec2 p;
+in vec2 q;
+in vec3 color;
+in float radius;
+in float diffAngle;
+
+flat out int kindF;
+out vec2 positionF;
+out vec2 pF;
+out vec2 qF;
+out vec3 colorF;
+out float radiusF;
+out float diffAngleF;
+
+// keep in sync with the SHAPE_ enum in gfx.c
+const int SHAPE_LINE = 0;
+const int SHAPE_CIRCLE = 1;
+const int SHAPE_ARC = 2;
+
+// Each instance is drawn as a quad made of two triangles. The corners are
+// in [-1,1]^2 and are selected by gl_VertexID, which runs from 0 to 5.
+vec2 compute_corner(int vertexID)
+{
+	if (vertexID == 0 || vertexID == 5)
+		return vec2(-1, -1);
+	if (vertexID == 1)
+		return vec2(-1, 1);
+	if (vertexID == 2 || vertexID == 3)
+		return vec2(1, 1);
+	return vec2(1, -1);
+}
+
+void main()
+{
+	vec2 corner = compute_corner(gl_VertexID);
+	vec2 position;
+	if (kind == SHAPE_LINE) {
+		// p and q are the end points, radius is half the line width.
+		// The quad is extended by the radius beyond each end point to
+		// make room for the round caps that are cut out in shape.frag.
+		vec2 d = q - p;
+		vec2 direction = vec2(1, 0);
+		if (length(d) > 0.0)
+			direction = normalize(d);
+		vec2 normal = vec2(direction.y, -direction.x);
+		position = mix(p, q, 0.5 * (corner.x + 1.0))
+			+ corner.x * radius * direction
+			+ corner.y * radius * normal;
+	}
+	else if (kind == SHAPE_CIRCLE) {
+		// p is the center point
+		position = p + radius * corner;
+	}
+	else {
+		// p is the start point, q is the center point
+		position = q + radius * corner;
+	}
+	kindF = kind;
+	positionF = position;
+	pF = p;
+	qF = q;
+	colorF = color;
+	radiusF = radius;
+	diffAngleF = diffAngle;
+	gl_Position = screenTransform * vec4(position, 0, 1);
+}
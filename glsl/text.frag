@@ -0,0 +1,13 @@
+#version 330 core
+
+// one channel, the coverage of the glyphs
+uniform sampler2D fontTexture;
+
+in vec2 texCoordF;
+in vec4 colorF;
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = vec4(colorF.rgb, colorF.a * texture(fontTexture, texCoordF).r);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+uniform vec2 screenSize;  // in pixels
+
+in vec2 position;  // in pixels from the top left
+in vec2 texCoord;  // in the font atlas
+in vec4 color;
+
+out vec2 texCoordF;
+out vec4 colorF;
+
+void main()
+{
+	texCoordF = texCoord;
+	colorF = color;
+	vec2 p = 2.0 * position / screenSize - 1.0;
+	gl_Position = vec4(p.x, -p.y, 0, 1);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+uniform sampler2D atlasTexture;
+
+in vec2 texCoordF;
+out vec4 fragColor;
+
+void main()
+{
+	vec4 color = texture(atlasTexture, texCoordF);
+	// nothing was drawn here, so don't occlude anything either
+	if (color.a == 0.0)
+		discard;
+	fragColor = color;
+}
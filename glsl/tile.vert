@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform mat4 screenTransform;
+
+in vec2 position;  // in the plane of the 2D shapes
+in vec2 texCoord;  // in the tile atlas
+
+out vec2 texCoordF;
+
+void main()
+{
+	texCoordF = texCoord;
+	gl_Position = screenTransform * vec4(position, 0, 1);
+}
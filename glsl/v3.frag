@@ -1,4 +1,4 @@
-#version 130
+#version 330 core
 #include "glsl/math.inc"
 
 uniform mat4 screenTransform;
@@ -6,6 +6,7 @@ uniform mat4 screenTransform;
 in vec3 positionF;
 in vec3 normalF;
 in vec3 colorF;
+out vec4 fragColor;
 
 float compute_specular_strength(vec3 lightPos, vec3 surfacePoint, vec3 normalizedSurfaceNormal, vec3 spectatorPosition) {
 	vec3 lightToSurface = surfacePoint - lightPos;
@@ -33,6 +34,8 @@ void main()
 	float lightIntensity = 0.5 + diffuseStrength;
 	if (lightIntensity < 0) lightIntensity = 0;
 	if (lightIntensity > 1) lightIntensity = 1;
-	gl_FragColor = vec4(lightIntensity * colorF, 1);
-	//gl_FragColor = vec4(positionF, 1);
+	// UNLIT is a variant axis (see process-shaders)
+	if (UNLIT != 0) lightIntensity = 1;
+	fragColor = vec4(lightIntensity * colorF, 1);
+	//fragColor = vec4(positionF, 1);
 }
@@ -0,0 +1,14 @@
+#ifndef SEGMENTS_CLOCK_H_INCLUDED
+#define SEGMENTS_CLOCK_H_INCLUDED
+
+#include <stdint.h>
+
+/* Monotonic clock. Only differences between two values are meaningful. */
+uint64_t get_time_ns(void);
+
+static inline double ns_to_ms(uint64_t ns)
+{
+        return (double) ns / 1e6;
+}
+
+#endif
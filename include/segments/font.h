@@ -0,0 +1,17 @@
+#ifndef SEGMENTS_FONT_H_INCLUDED
+#define SEGMENTS_FONT_H_INCLUDED
+
+/* A 5x7 bitmap font with the printable ASCII characters from ' ' to '_'
+(no lowercase letters). Each glyph is 7 rows from the top, and in each row
+bit 4 is the leftmost pixel. */
+enum {
+        FONT_FIRST_CHAR = ' ',
+        FONT_LAST_CHAR = '_',
+        NUM_FONT_GLYPHS = FONT_LAST_CHAR - FONT_FIRST_CHAR + 1,
+        FONT_GLYPH_WIDTH = 5,
+        FONT_GLYPH_HEIGHT = 7,
+};
+
+extern const unsigned char fontGlyphs[NUM_FONT_GLYPHS][FONT_GLYPH_HEIGHT];
+
+#endif
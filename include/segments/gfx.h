@@ -1,9 +1,30 @@
 #ifndef SEGMENTS_GFX_H_INCLUDED
 #define SEGMENTS_GFX_H_INCLUDED
 
+#include <stdint.h>
+
 // used by main.c
 void do_gfx(void);
 
+/* Counts of the work done in one frame. The limits in SEGMENTS_STATS_LIMITS
+(for example "drawCalls=8,bytesUploaded=4096", optionally "from=10" to skip
+the first frames) are checked at the end of each frame, and exceeding one is
+fatal, so that a test run catches regressions like uploading everything
+again each frame. */
+struct GfxStats {
+        uint64_t numDrawCalls;
+        uint64_t numProgramBinds;
+        uint64_t numVaoBinds;
+        uint64_t numVertices;  // counting each instance
+        uint64_t numBytesUploaded;
+        uint64_t numReallocs;
+        uint64_t numEvents;
+        uint64_t numDroppedEvents;
+};
+
+// the counts of the last completed frame
+void get_gfx_stats(struct GfxStats *stats);
+
 // The rest is the interface segments/gfx.c <-> autogenerated/shaders.c
 
 enum {
@@ -23,6 +44,16 @@ enum {
         GRAFIKATTRTYPE_VEC4,
 };
 
+/* Formats for vertex data that is stored in a more compact form than the
+type of the shader attribute. The data gets converted when it is fetched. */
+enum {
+        ATTRIBFORMAT_SNORM16,  // 16-bit signed integers, normalized to [-1,1]
+        ATTRIBFORMAT_UNORM8,  // 8-bit unsigned integers, normalized to [0,1]
+        ATTRIBFORMAT_SNORM_2_10_10_10_REV,  // xyz as 10-bit signed normalized integers, w as 2-bit
+        ATTRIBFORMAT_UINT8,  // 8-bit unsigned integers, for integer attributes
+        NUM_ATTRIBFORMAT_KINDS,
+};
+
 enum {
         GRAFIKUNIFORMTYPE_BOOL,
         GRAFIKUNIFORMTYPE_INT,
@@ -35,6 +66,7 @@ enum {
         GRAFIKUNIFORMTYPE_MAT2,
         GRAFIKUNIFORMTYPE_MAT3,
         GRAFIKUNIFORMTYPE_MAT4,
+        GRAFIKUNIFORMTYPE_SAMPLER2D,
 };
 
 typedef int GfxShader;
@@ -49,10 +81,18 @@ struct SM_ShaderInfo {
         const char *shaderSource;
         int shaderSourceSize;
         int shadertypeKind;
+        const char *filepath;  // relative to the source tree
 };
 
 struct SM_ProgramInfo {
         const char *name;
+        // the program whose shaders and attributes are used. Differs from
+        // the program itself only for variants.
+        int baseProgramIndex;
+        // #define lines that are inserted after the #version line
+        const char *defines;
+        // index of the location of the first uniform in gfxUniformLocation[]
+        int firstUniformLocation;
 };
 
 struct SM_LinkInfo {
@@ -70,6 +110,7 @@ struct SM_AttributeInfo {
         int programIndex;
         int typeKind;
         const char *name;
+        GfxAttributeLocation location;  // assigned by process-shaders
 };
 
 struct SM_Description {
@@ -82,9 +123,7 @@ struct SM_Description {
 
         // output locations for compiled shaders / metadata
         GfxProgram *gfxProgram;
-        GfxShader *gfxShader;
         GfxUniformLocation *gfxUniformLocation;
-        GfxAttributeLocation *gfxAttributeLocation;
 
         int numPrograms;
         int numShaders;
@@ -111,6 +150,22 @@ struct Vec4 {
         float w;
 };
 
+struct Snorm16Vec3 {
+        short x;
+        short y;
+        short z;
+        short unused;  // keeps the vertex data 4-byte aligned
+};
+
+struct Unorm8Vec4 {
+        unsigned char x;
+        unsigned char y;
+        unsigned char z;
+        unsigned char w;
+};
+
+typedef unsigned int Snorm_2_10_10_10_Rev;
+
 struct Mat2 {
         float mat[2][2];
 };
@@ -123,6 +178,7 @@ struct Mat4 {
         float mat[4][4];
 };
 
+void set_uniform_1i(int program, int location, int x);
 void set_uniform_1f(int program, int location, float x);
 void set_uniform_2f(int program, int location, float x, float y);
 void set_uniform_3f(int program, int location, float x, float y, float z);
@@ -132,5 +188,6 @@ void set_uniform_mat3f(int program, int location, const struct Mat3 *mat);
 void set_uniform_mat4f(int program, int location, const struct Mat4 *mat);
 
 void set_attribpointer(int attribKind, GfxVAO vao, GfxVBO vbo, int stride, int offset);
+void set_packed_attribpointer(int attribKind, int attribformatKind, GfxVAO vao, GfxVBO vbo, int stride, int offset, int size);
 
 #endif
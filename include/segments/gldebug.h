@@ -0,0 +1,15 @@
+#ifndef SEGMENTS_GLDEBUG_H_INCLUDED
+#define SEGMENTS_GLDEBUG_H_INCLUDED
+
+/* Reporting of GL errors and driver warnings through GL_KHR_debug. The
+driver calls us back (possibly from its own threads) when something happens,
+so nothing needs to ask for errors with glGetError(), which can make us wait
+for the driver. Messages below SEGMENTS_GL_DEBUG_SEVERITY (high, medium, low
+or notification; default low) are filtered out by the driver, and each kind
+of message is only reported a few times. Errors and performance warnings are
+logged as warnings, notifications at the debug level. */
+
+// Returns 0 if GL_KHR_debug is not available.
+int setup_gl_debug_output(void);
+
+#endif
@@ -1,5 +1,79 @@
+#ifndef SEGMENTS_LOGGING_H_INCLUDED
+#define SEGMENTS_LOGGING_H_INCLUDED
+
 #include <stdarg.h>
+#include <stdint.h>
+
+/* Log messages are formatted on the calling thread into a ring buffer of
+that thread, and written out by a background thread, so logging never waits
+for the terminal. If a ring is full, its messages are dropped (and counted)
+instead of waiting.
+
+Which messages are written is set with SEGMENTS_LOG_LEVEL, a comma separated
+list of a level for all categories and category=level pairs, for example
+"warning,shaders=debug". SEGMENTS_LOG_FILE writes the log to a file instead
+of stderr, and SEGMENTS_LOG_FORMAT=binary writes the records to it as they
+are (see struct LogfileRecord), which is cheaper for large amounts of
+tracing. */
+
+enum {
+        LOGLEVEL_DEBUG,
+        LOGLEVEL_INFO,
+        LOGLEVEL_WARNING,
+        LOGLEVEL_ERROR,
+        NUM_LOGLEVEL_KINDS,
+};
+
+enum {
+        LOGCATEGORY_GENERAL,
+        LOGCATEGORY_GFX,
+        LOGCATEGORY_GL,  // the driver and what it supports
+        LOGCATEGORY_SHADERS,
+        LOGCATEGORY_WINDOW,
+        NUM_LOGCATEGORY_KINDS,
+};
+
+/* In binary log files, each record is followed by the text of the message
+(length bytes, no terminating zero). The file starts with "SEGLOG1\n". */
+struct LogfileRecord {
+        uint64_t timeNs;  // get_time_ns() when the message was logged
+        uint8_t loglevelKind;
+        uint8_t logcategoryKind;
+        uint16_t length;
+        uint32_t threadIndex;
+};
+
+/* Each call site of the LOG_ macros has one of these, so a message that is
+logged every frame doesn't flood the log. */
+struct LogSite {
+        uint64_t intervalStartNs;
+        int numInInterval;
+        int numSuppressed;
+};
+
+// Starts the writer thread. Until then, messages are written directly.
+void start_logging(void);
+// Writes out everything that was logged so far.
+void flush_log(void);
+
+int is_logged(int loglevelKind, int logcategoryKind);
+void log_fv(struct LogSite *site, int loglevelKind, int logcategoryKind, const char *fmt, va_list ap);
+void log_f(struct LogSite *site, int loglevelKind, int logcategoryKind, const char *fmt, ...);
+
+#define LOG(loglevelKind, logcategoryKind, ...) do { \
+        static struct LogSite logSite_; \
+        log_f(&logSite_, (loglevelKind), (logcategoryKind), __VA_ARGS__); \
+} while (0)
+#define LOG_DEBUG(logcategoryKind, ...) LOG(LOGLEVEL_DEBUG, (logcategoryKind), __VA_ARGS__)
+#define LOG_INFO(logcategoryKind, ...) LOG(LOGLEVEL_INFO, (logcategoryKind), __VA_ARGS__)
+#define LOG_WARNING(logcategoryKind, ...) LOG(LOGLEVEL_WARNING, (logcategoryKind), __VA_ARGS__)
+#define LOG_ERROR(logcategoryKind, ...) LOG(LOGLEVEL_ERROR, (logcategoryKind), __VA_ARGS__)
+
+// Info message in the general category, not rate limited
 void message_fv(const char *fmt, va_list ap);
 void message_f(const char *fmt, ...);
 
+// Logs an error, writes out the log and aborts.
 void fatal_f(const char *fmt, ...);
+
+#endif
@@ -1,6 +1,10 @@
+#include <stdint.h>
+
 void realloc_memory(void **ptr, int numElems, int elemSize);
 void alloc_memory(void **ptr, int numElems, int elemSize);
 void free_memory(void **ptr);
+// calls of realloc_memory() since the start, i.e. allocations and growths
+uint64_t get_number_of_reallocs(void);
 
 static inline int get_number_of_allocated_elems(void *ptr)
 {
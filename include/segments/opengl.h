@@ -1,7 +1,18 @@
 void create_opengl_context(void);
+/* A second context that shares its objects with the main one, for a worker
+thread. Returns 0 if there is none. */
+int create_upload_context(void);
+// Returns 0 on failure
+int make_upload_context_current(void);
+// Makes no context current on the calling thread
+void release_upload_context(void);
 void *load_opengl_pointer(const char *name);
 void setup_opengl(void);
 void swap_buffers(void);
+// Returns how many frames ago the contents of the back buffer were drawn, or
+// 0 if the contents are unknown.
+int get_back_buffer_age(void);
+int have_gl_extension(const char *name);
 
 #ifdef _WIN32
 #include <Windows.h>  // otherwise GL.h doesn't work
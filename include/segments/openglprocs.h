@@ -10,24 +10,54 @@ MAKE(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays)
 MAKE(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays)
 
         MAKE(PFNGLBUFFERDATAPROC, glBufferData)
+        MAKE(PFNGLBUFFERSUBDATAPROC, glBufferSubData)
         MAKE(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray)
         MAKE(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray)
         MAKE(PFNGLBINDBUFFERPROC, glBindBuffer)
         MAKE(PFNGLUSEPROGRAMPROC, glUseProgram)
         MAKE(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)
-        MAKE(PFNGLGETATTRIBLOCATIONPROC, glGetAttribLocation)
+        MAKE(PFNGLVERTEXATTRIBIPOINTERPROC, glVertexAttribIPointer)
+        MAKE(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor)
+        MAKE(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced)
+        MAKE(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation)
+        MAKE(PFNGLBINDFRAGDATALOCATIONPROC, glBindFragDataLocation)
         MAKE(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation)
         MAKE(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog)
         MAKE(PFNGLGETSHADERIVPROC, glGetShaderiv)
         MAKE(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog)
         MAKE(PFNGLGETPROGRAMIVPROC, glGetProgramiv)
+        MAKE(PFNGLDELETEPROGRAMPROC, glDeleteProgram)
+        MAKE(PFNGLDELETESHADERPROC, glDeleteShader)
+        MAKE(PFNGLPROGRAMPARAMETERIPROC, glProgramParameteri)
+        MAKE(PFNGLGETPROGRAMBINARYPROC, glGetProgramBinary)
+        MAKE(PFNGLPROGRAMBINARYPROC, glProgramBinary)
+        MAKE(PFNGLGETSTRINGIPROC, glGetStringi)
+        MAKE(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC, glMaxShaderCompilerThreadsKHR)
+        MAKE(PFNGLMAXSHADERCOMPILERTHREADSARBPROC, glMaxShaderCompilerThreadsARB)
         MAKE(PFNGLTEXIMAGE2DMULTISAMPLEPROC, glTexImage2DMultisample)
         MAKE(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers)
         MAKE(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus)
         MAKE(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer)
         MAKE(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D)
         MAKE(PFNGLBLITFRAMEBUFFERPROC, glBlitFramebuffer)
+        MAKE(PFNGLBLENDFUNCSEPARATEPROC, glBlendFuncSeparate)
+        MAKE(PFNGLGENQUERIESPROC, glGenQueries)
+        MAKE(PFNGLBEGINQUERYPROC, glBeginQuery)
+        MAKE(PFNGLENDQUERYPROC, glEndQuery)
+        MAKE(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv)
+        MAKE(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v)
+        MAKE(PFNGLDEBUGMESSAGECALLBACKPROC, glDebugMessageCallback)
+        MAKE(PFNGLDEBUGMESSAGECONTROLPROC, glDebugMessageControl)
+        MAKE(PFNGLFENCESYNCPROC, glFenceSync)
+        MAKE(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync)
+        MAKE(PFNGLDELETESYNCPROC, glDeleteSync)
+        MAKE(PFNGLCOPYBUFFERSUBDATAPROC, glCopyBufferSubData)
+#ifdef _WIN32
+        // OpenGL 1.3, but declared as a function in the GL/gl.h of other platforms
+        MAKE(PFNGLACTIVETEXTUREPROC, glActiveTexture)
+#endif
 
+MAKE(PFNGLUNIFORM1IPROC, glUniform1i)
 MAKE(PFNGLUNIFORM1FPROC, glUniform1f)
 MAKE(PFNGLUNIFORM2FPROC, glUniform2f)
 MAKE(PFNGLUNIFORM3FPROC, glUniform3f)
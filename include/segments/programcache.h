@@ -0,0 +1,18 @@
+#ifndef SEGMENTS_PROGRAMCACHE_H_INCLUDED
+#define SEGMENTS_PROGRAMCACHE_H_INCLUDED
+
+/* On-disk cache of linked program binaries, so the shaders don't need to be
+compiled on every start. The cache is keyed by a hash of the embedded shader
+sources and the GL vendor, renderer and version strings. It lives in
+$XDG_CACHE_HOME/segments/ (or ~/.cache/segments/). Set the environment
+variable SEGMENTS_NO_PROGRAM_CACHE to bypass it. */
+
+// Creates the programs in gfxProgram[] from the cache. Returns 0 if that
+// is not possible, in which case no programs were created. Variants are only
+// created if they are in the cache, the others are left 0.
+int load_programs_from_cache(void);
+
+// Stores the programs in gfxProgram[] that are ready (linked) in the cache.
+void store_programs_in_cache(const int *programIsReady);
+
+#endif
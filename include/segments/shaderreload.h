@@ -0,0 +1,24 @@
+#ifndef SEGMENTS_SHADERRELOAD_H_INCLUDED
+#define SEGMENTS_SHADERRELOAD_H_INCLUDED
+
+/* Development mode: the GLSL files that the embedded shaders were made from
+are watched, so changed shaders can be recompiled without restarting. Build
+with -DSEGMENTS_SHADER_HOT_RELOAD to enable it (Linux only, uses inotify).
+The file paths are relative to the source tree, so run the program from
+there. Only the shader code can be changed this way, changes to the
+attributes or uniforms still need process-shaders. */
+
+// Starts watching the shader files. Returns 0 if hot reloading is not
+// available.
+int start_watching_shader_files(void);
+
+// Checks, without blocking, if shader files changed. For each shader whose
+// source changed, changedShaders[shaderIndex] is set to 1. Returns whether
+// there were any changes.
+int check_shader_files(int *changedShaders);
+
+// Returns the source of the shader as reloaded from its file, or NULL if
+// the shader was never reloaded.
+const char *get_reloaded_shader_source(int shaderIndex, int *outSize);
+
+#endif
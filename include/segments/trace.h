@@ -0,0 +1,45 @@
+#ifndef SEGMENTS_TRACE_H_INCLUDED
+#define SEGMENTS_TRACE_H_INCLUDED
+
+/* CPU tracing. TRACE_SCOPE("name") measures the time from where it is to
+the end of the enclosing block, and records it in a buffer of the calling
+thread. At exit, all buffers are written as a Chrome trace (JSON), which
+ui.perfetto.dev and chrome://tracing can show, to SEGMENTS_TRACE_FILE or the
+file given to START_TRACING().
+
+Build with -DSEGMENTS_TRACE to enable it, otherwise the macros compile to
+nothing. The end of the scope is found with __attribute__((cleanup)), so
+only GCC and Clang can build with tracing. The names must be string
+literals (or otherwise live until exit). */
+
+#ifdef SEGMENTS_TRACE
+
+#if !defined __GNUC__
+#error "SEGMENTS_TRACE needs __attribute__((cleanup)), build with GCC or Clang"
+#endif
+
+#include <segments/clock.h>
+
+struct TraceScope {
+        const char *name;
+        uint64_t startNs;
+};
+
+void start_tracing(const char *filepath);
+void end_trace_scope(struct TraceScope *scope);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+        struct TraceScope TRACE_CONCAT(traceScope_, __LINE__) \
+        __attribute__((cleanup(end_trace_scope))) = { (name), get_time_ns() }
+#define START_TRACING(filepath) start_tracing(filepath)
+
+#else
+
+#define TRACE_SCOPE(name) ((void) 0)
+#define START_TRACING(filepath) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SEGMENTS_UPLOAD_H_INCLUDED
+#define SEGMENTS_UPLOAD_H_INCLUDED
+
+#include <segments/opengl.h>
+#include <stddef.h>
+
+/* Buffer uploads on a worker thread with its own context, which shares its
+objects with the main context. The worker makes a new buffer, copies the
+part of the old buffer that is kept, and writes the new data after it, in
+chunks so that the driver never has to copy all of it at once. A fence tells
+the main thread when the new buffer can be used. Until then the main thread
+keeps drawing from the old buffer, and it must not change or delete it.
+
+It needs GL_ARB_sync and GL_ARB_copy_buffer, and can be turned off with
+SEGMENTS_UPLOAD_WORKER=0. */
+
+// Returns 0 if the uploads can't be done on a worker, must be called on the
+// main thread with the main context current.
+int start_upload_worker(void);
+/* Queues an upload of the first keepSize bytes of oldBuffer (which may be 0
+if keepSize is 0) followed by size bytes of data, into a new buffer. data
+must be allocated with ALLOC_MEMORY() or REALLOC_MEMORY() and is freed by the
+worker. Returns the ID of the upload, or -1 if too many are in flight (data
+is freed anyway). */
+int start_upload(GLuint oldBuffer, size_t keepSize, void *data, size_t size);
+/* Returns 1 if the worker can't take uploads (anymore), because it couldn't
+make its context current or was stopped. start_upload() then always returns
+-1, so the caller has to upload on the main thread. */
+int has_upload_worker_failed(void);
+/* Returns 0 while the upload is in flight. After that it returns 1 once
+and sets *buffer to the new buffer, which now belongs to the caller, or to
+0 if the upload failed. Doesn't wait. */
+int poll_upload(int uploadId, GLuint *buffer);
+/* Makes the worker release its context and exit, and waits for it. The
+uploads in flight are dropped. Must be called before close_window(), which
+destroys the upload context. */
+void stop_upload_worker(void);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef SEGMENTS_WINDOW_H_INCLUDED
 #define SEGMENTS_WINDOW_H_INCLUDED
 
+#include <stdint.h>
+
 enum {
         KEY_ENTER,
         KEY_ESCAPE,
@@ -80,6 +82,7 @@ struct WindowresizeEvent {
 
 struct Event {
         int eventKind;
+        uint64_t timeNs;  // get_time_ns() when it was fetched from the window system
         union {
                 struct KeyEvent tKey;
                 struct MousebuttonEvent tMousebutton;
@@ -95,8 +98,14 @@ void send_mousebutton_event(int mousebuttonKind, int mousebuttoneventKind);
 void send_mousemove_event(int x, int y);
 void send_scroll_event(float amount);
 void fetch_all_pending_events(void);
+/* The current position of the mouse in the window, queried from the window
+system (possibly a round trip). It can be newer than the last mousemove
+event. Returns 0 if it isn't known. */
+int query_mouse_position(int *x, int *y);
 int have_events(void);
 void dequeue_event(struct Event *event);
+// events that didn't fit in the queue, since the start
+uint64_t get_number_of_dropped_events(void);
 
 void close_window(void);
 
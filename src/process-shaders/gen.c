@@ -2,6 +2,7 @@
 #include <glsl-processor/logging.h>
 #include <glsl-processor/memory.h>
 #include <glsl-processor/parse.h>
+#include <segments/trace.h>
 
 #ifdef _MSC_VER
 #include <Windows.h>
@@ -227,12 +228,345 @@ static const char *const typeKind_to_GRAFIKUNIFORMTYPE[GP_NUM_TYPE_KINDS] = {
         [GP_TYPE_MAT2] = "GRAFIKUNIFORMTYPE_MAT2",
         [GP_TYPE_MAT3] = "GRAFIKUNIFORMTYPE_MAT3",
         [GP_TYPE_MAT4] = "GRAFIKUNIFORMTYPE_MAT4",
+        [GP_TYPE_SAMPLER2D] = "GRAFIKUNIFORMTYPE_SAMPLER2D",
 };
 
+/* Size and alignment of the C types in typeKind_to_real_type, used to lay
+out the generated vertex structs. */
+static const struct {
+        int size;
+        int alignment;
+} typeKind_to_layout[GP_NUM_TYPE_KINDS] = {
+        [GP_TYPE_BOOL] = { 4, 4 },
+        [GP_TYPE_INT] = { 4, 4 },
+        [GP_TYPE_UINT] = { 4, 4 },
+        [GP_TYPE_FLOAT] = { 4, 4 },
+        [GP_TYPE_DOUBLE] = { 8, 8 },
+        [GP_TYPE_VEC2] = { 8, 4 },
+        [GP_TYPE_VEC3] = { 12, 4 },
+        [GP_TYPE_VEC4] = { 16, 4 },
+};
+
+/* C types for attributes that are stored in one of the ATTRIBFORMAT_ formats
+from segments/gfx.h. */
+static const struct {
+        const char *formatName;
+        int typeKind;  // type of the attribute in the shader
+        const char *realType;
+        int size;
+        int alignment;
+} packedTypeInfo[] = {
+        { "SNORM16", GP_TYPE_VEC3, "struct Snorm16Vec3", 8, 2 },
+        { "UNORM8", GP_TYPE_VEC3, "struct Unorm8Vec4", 4, 1 },
+        { "UNORM8", GP_TYPE_VEC4, "struct Unorm8Vec4", 4, 1 },
+        { "SNORM_2_10_10_10_REV", GP_TYPE_VEC3, "Snorm_2_10_10_10_Rev", 4, 4 },
+        { "SNORM_2_10_10_10_REV", GP_TYPE_VEC4, "Snorm_2_10_10_10_Rev", 4, 4 },
+        { "UINT8", GP_TYPE_INT, "unsigned char", 1, 1 },
+        { "UINT8", GP_TYPE_UINT, "unsigned char", 1, 1 },
+};
+
+static struct {
+        const char *shaderName;
+        const char *filepath;
+} shaderFilepaths[64];
+static int numShaderFilepaths;
+
+/* Record the file that a shader is made from. It is written to the shader
+info, so that the shader can be reloaded from the file at runtime. */
+void set_shader_filepath(const char *shaderName, const char *filepath)
+{
+        if (numShaderFilepaths == sizeof shaderFilepaths / sizeof shaderFilepaths[0])
+                gp_fatal_f("Too many shader files");
+        shaderFilepaths[numShaderFilepaths].shaderName = shaderName;
+        shaderFilepaths[numShaderFilepaths].filepath = filepath;
+        numShaderFilepaths++;
+}
+
+static const char *find_shader_filepath(const char *shaderName)
+{
+        for (int i = 0; i < numShaderFilepaths; i++)
+                if (!strcmp(shaderFilepaths[i].shaderName, shaderName))
+                        return shaderFilepaths[i].filepath;
+        gp_fatal_f("No file recorded for shader '%s'", shaderName);
+        return NULL;
+}
+
+/* glsl-processor drops the #version line from its output, so the one of the
+shader file is written in front of the embedded source. */
+static void append_version_line(struct MemoryBuffer *mb, const char *filepath)
+{
+        FILE *f = fopen(filepath, "rb");
+        if (f == NULL)
+                gp_fatal_f("Failed to open '%s'", filepath);
+        char line[256];
+        int found = 0;
+        while (!found && fgets(line, sizeof line, f) != NULL)
+                found = !strncmp(line, "#version", 8);
+        fclose(f);
+        if (!found)
+                gp_fatal_f("No #version line in '%s'", filepath);
+        text_to_cstring_literal(mb, line, (int) strcspn(line, "\r\n"));
+        text_to_cstring_literal(mb, "\n", 1);
+}
+
+// defined in minify.c
+extern void minify_glsl(const char *src, int size, char **outText, int *outSize);
+
+static int minifyShaders;
+
+/* Request that the embedded shader sources are minified (see minify.c). This
+makes the sources smaller and faster to compile, but harder to read in the
+driver's error messages. */
+void set_minify_shaders(int enable)
+{
+        minifyShaders = enable;
+}
+
+static struct {
+        const char *programName;
+        const char *attributeName;
+        const char *formatName;
+} attributeFormats[64];
+static int numAttributeFormats;
+
+/* Request that an attribute is stored in the given format (the name of an
+ATTRIBFORMAT_ value, without the prefix) in the generated vertex struct.
+Attributes without a format are stored as their shader type. */
+void set_attribute_format(const char *programName, const char *attributeName, const char *formatName)
+{
+        if (numAttributeFormats == sizeof attributeFormats / sizeof attributeFormats[0])
+                gp_fatal_f("Too many attribute formats");
+        attributeFormats[numAttributeFormats].programName = programName;
+        attributeFormats[numAttributeFormats].attributeName = attributeName;
+        attributeFormats[numAttributeFormats].formatName = formatName;
+        numAttributeFormats++;
+}
+
+static const char *find_attribute_format(const char *programName, const char *attributeName)
+{
+        for (int i = 0; i < numAttributeFormats; i++)
+                if (!strcmp(attributeFormats[i].programName, programName)
+                    && !strcmp(attributeFormats[i].attributeName, attributeName))
+                        return attributeFormats[i].formatName;
+        return NULL;
+}
+
+static void check_attribute_formats(struct GP_Ctx *ctx)
+{
+        for (int i = 0; i < numAttributeFormats; i++) {
+                int found = 0;
+                for (int j = 0; j < ctx->numProgramAttributes; j++) {
+                        const char *programName = ctx->desc.programInfo[ctx->programAttributes[j].programIndex].programName;
+                        if (!strcmp(attributeFormats[i].programName, programName)
+                            && !strcmp(attributeFormats[i].attributeName, ctx->programAttributes[j].attributeName))
+                                found = 1;
+                }
+                if (!found)
+                        gp_fatal_f("Format given for attribute '%s' of program '%s', but there is no such attribute",
+                                   attributeFormats[i].attributeName, attributeFormats[i].programName);
+        }
+}
+
+enum {
+        MAX_VARIANT_AXES_PER_PROGRAM = 4,
+};
+
+static struct {
+        const char *programName;
+        const char *defineName;
+} variantAxes[32];
+static int numVariantAxes;
+
+/* Declare a permutation axis of a program: a macro that is #define'd to 0 or
+1 at the top of the program's shaders. A program with N axes gets 2^N - 1
+variants besides itself, named after the axes that are 1 (for example
+PROGRAM_v3_UNLIT). The variants are compiled at runtime when they are first
+used. */
+void add_program_variant_axis(const char *programName, const char *defineName)
+{
+        if (numVariantAxes == sizeof variantAxes / sizeof variantAxes[0])
+                gp_fatal_f("Too many variant axes");
+        variantAxes[numVariantAxes].programName = programName;
+        variantAxes[numVariantAxes].defineName = defineName;
+        numVariantAxes++;
+}
+
+/* Get the axes of the given program, in the order they were added. Returns
+the number of axes. */
+static int get_variant_axes(const char *programName, const char **axes)
+{
+        int numAxes = 0;
+        for (int i = 0; i < numVariantAxes; i++)
+                if (!strcmp(variantAxes[i].programName, programName))
+                        axes[numAxes++] = variantAxes[i].defineName;
+        return numAxes;
+}
+
+static void check_variant_axes(struct GP_Ctx *ctx)
+{
+        for (int i = 0; i < numVariantAxes; i++) {
+                const char *programName = variantAxes[i].programName;
+                int found = 0;
+                for (int j = 0; j < ctx->desc.numPrograms; j++)
+                        if (!strcmp(ctx->desc.programInfo[j].programName, programName))
+                                found = 1;
+                if (!found)
+                        gp_fatal_f("Variant axis '%s' given for program '%s', but there is no such program",
+                                   variantAxes[i].defineName, programName);
+                const char *axes[sizeof variantAxes / sizeof variantAxes[0]];
+                if (get_variant_axes(programName, axes) > MAX_VARIANT_AXES_PER_PROGRAM)
+                        gp_fatal_f("Too many variant axes for program '%s'", programName);
+        }
+}
+
+/* Name of a program variant, without the PROGRAM_ prefix. The variant is
+given as a bitmask of axes. */
+static void variant_name(struct MemoryBuffer *mb, const char *programName, const char **axes, int numAxes, int variant)
+{
+        append_to_buffer_f(mb, "%s", programName);
+        for (int k = 0; k < numAxes; k++)
+                if (variant & (1 << k))
+                        append_to_buffer_f(mb, "_%s", axes[k]);
+}
+
+/* Write the parameter list and the body of the setter function for the given
+uniform. Programs that have variants get an additional first parameter to
+select the program or one of its variants. */
+static void write_uniform_setter_tail(struct WriteCtx *wc, const struct GP_ProgramUniform *uniform)
+{
+        const char *programName = wc->ctx->desc.programInfo[uniform->programIndex].programName;
+        const char *uniformName = uniform->uniformName;
+        const char *params;
+        const char *setter;
+        const char *args;
+        switch (uniform->typeKind) {
+        case GP_TYPE_FLOAT: params = "float x"; setter = "set_uniform_1f"; args = "x"; break;
+        case GP_TYPE_VEC2: params = "float x, float y"; setter = "set_uniform_2f"; args = "x, y"; break;
+        case GP_TYPE_VEC3: params = "float x, float y, float z"; setter = "set_uniform_3f"; args = "x, y, z"; break;
+        case GP_TYPE_VEC4: params = "float x, float y, float z, float w"; setter = "set_uniform_4f"; args = "x, y, z, w"; break;
+        case GP_TYPE_MAT2: params = "const struct Mat2 *mat"; setter = "set_uniform_mat2f"; args = "mat"; break;
+        case GP_TYPE_MAT3: params = "const struct Mat3 *mat"; setter = "set_uniform_mat3f"; args = "mat"; break;
+        case GP_TYPE_MAT4: params = "const struct Mat4 *mat"; setter = "set_uniform_mat4f"; args = "mat"; break;
+        // samplers are set to the texture unit that they read from
+        case GP_TYPE_SAMPLER2D: params = "int textureUnit"; setter = "set_uniform_1i"; args = "textureUnit"; break;
+        default: gp_fatal_f("Not implemented!");
+        }
+        const char *axes[MAX_VARIANT_AXES_PER_PROGRAM];
+        if (get_variant_axes(programName, axes) == 0)
+                append_to_buffer_f(&wc->hFile, "(%s) { %s(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], %s); }\n",
+                                   params, setter, programName, programName, uniformName, args);
+        else
+                append_to_buffer_f(&wc->hFile, "(int programIndex, %s) { %s(gfxProgram[programIndex], gfxUniformLocation[smProgramInfo[programIndex].firstUniformLocation + UNIFORM_%s_%s - smProgramInfo[PROGRAM_%s].firstUniformLocation], %s); }\n",
+                                   params, setter, programName, uniformName, programName, args);
+}
+
+struct VertexMember {
+        const struct GP_ProgramAttribute *attr;
+        const char *realType;
+        const char *formatName;  // NULL if not packed
+        int size;
+        int alignment;
+};
+
+/* Collect the members of the vertex struct of the given program, ordered
+such that there is as little padding as possible: by decreasing alignment,
+and by decreasing size if the alignment is the same. Returns the number of
+members. */
+static int layout_vertex_struct(struct GP_Ctx *ctx, int programIndex, struct VertexMember *members, int maxMembers)
+{
+        const char *programName = ctx->desc.programInfo[programIndex].programName;
+        int numMembers = 0;
+        for (int i = 0; i < ctx->numProgramAttributes; i++) {
+                const struct GP_ProgramAttribute *attr = &ctx->programAttributes[i];
+                if (attr->programIndex != programIndex)
+                        continue;
+                if (numMembers == maxMembers)
+                        gp_fatal_f("Too many attributes in program '%s'", programName);
+                struct VertexMember m = { attr };
+                m.formatName = find_attribute_format(programName, attr->attributeName);
+                if (m.formatName == NULL) {
+                        m.realType = typeKind_to_real_type[attr->typeKind];
+                        m.size = typeKind_to_layout[attr->typeKind].size;
+                        m.alignment = typeKind_to_layout[attr->typeKind].alignment;
+                }
+                else {
+                        for (int j = 0; j < sizeof packedTypeInfo / sizeof packedTypeInfo[0]; j++) {
+                                if (!strcmp(packedTypeInfo[j].formatName, m.formatName)
+                                    && packedTypeInfo[j].typeKind == attr->typeKind) {
+                                        m.realType = packedTypeInfo[j].realType;
+                                        m.size = packedTypeInfo[j].size;
+                                        m.alignment = packedTypeInfo[j].alignment;
+                                }
+                        }
+                        if (m.realType == NULL)
+                                gp_fatal_f("Format %s can't be used for attribute '%s' of program '%s'",
+                                           m.formatName, attr->attributeName, programName);
+                }
+                GP_ENSURE(m.realType != NULL && m.size > 0);
+                // insertion sort, stable, so members with the same layout stay in name order
+                int j = numMembers++;
+                for (; j > 0; j--) {
+                        struct VertexMember *prev = &members[j - 1];
+                        if (prev->alignment > m.alignment
+                            || (prev->alignment == m.alignment && prev->size >= m.size))
+                                break;
+                        members[j] = *prev;
+                }
+                members[j] = m;
+        }
+        return numMembers;
+}
+
+static void write_vertex_structs(struct WriteCtx *wc)
+{
+        struct GP_Ctx *ctx = wc->ctx;
+        for (int pi = 0; pi < ctx->desc.numPrograms; pi++) {
+                const char *programName = ctx->desc.programInfo[pi].programName;
+                struct VertexMember members[32];
+                int numMembers = layout_vertex_struct(ctx, pi, members, sizeof members / sizeof members[0]);
+                if (numMembers == 0)
+                        continue;
+                int offset = 0;
+                int maxAlignment = 1;
+                append_to_buffer_f(&wc->hFile, "struct %sVertex {\n", programName);
+                for (int i = 0; i < numMembers; i++) {
+                        GP_ENSURE(offset % members[i].alignment == 0);
+                        append_to_buffer_f(&wc->hFile, INDENT "%s %s;  // offset %d\n",
+                                           members[i].realType, members[i].attr->attributeName, offset);
+                        offset += members[i].size;
+                        if (maxAlignment < members[i].alignment)
+                                maxAlignment = members[i].alignment;
+                }
+                int size = (offset + maxAlignment - 1) / maxAlignment * maxAlignment;
+                append_to_buffer_f(&wc->hFile, "};\n");
+                // catch disagreement between the layout computed here and the compiler
+                append_to_buffer_f(&wc->hFile, "typedef char %sVertex_CHECK_SIZE[sizeof (struct %sVertex) == %d ? 1 : -1];\n",
+                                   programName, programName, size);
+                append_to_buffer_f(&wc->hFile, "void setup_%s_vao(GfxVAO vao, GfxVBO vbo);\n\n", programName);
+
+                append_to_buffer_f(&wc->cFile, "void setup_%s_vao(GfxVAO vao, GfxVBO vbo)\n{\n", programName);
+                for (int i = 0; i < numMembers; i++) {
+                        const char *attributeName = members[i].attr->attributeName;
+                        if (members[i].formatName == NULL)
+                                append_to_buffer_f(&wc->cFile, INDENT "SET_ATTRIBPOINTER_%s_%s(vao, vbo, struct %sVertex, %s);\n",
+                                                   programName, attributeName, programName, attributeName);
+                        else
+                                append_to_buffer_f(&wc->cFile, INDENT "SET_PACKED_ATTRIBPOINTER_%s_%s(vao, vbo, struct %sVertex, %s, ATTRIBFORMAT_%s);\n",
+                                                   programName, attributeName, programName, attributeName, members[i].formatName);
+                }
+                append_to_buffer_f(&wc->cFile, "}\n\n");
+        }
+}
+
 void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
 {
+        TRACE_SCOPE("write_c_interface");
         struct WriteCtx mtsCtx = { 0 };
         struct WriteCtx *wc = &mtsCtx;
+        wc->ctx = ctx;
+
+        check_attribute_formats(ctx);
+        check_variant_axes(ctx);
 
         append_filepath_component(&wc->hFilepath, autogenDirpath);
         append_filepath_component(&wc->cFilepath, autogenDirpath);
@@ -244,18 +578,43 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
                 "#define AUTOGENERATED_SHADERS_H_INCLUDED\n"
                 "\n"
                 "#include <segments/gfx.h>\n"
+                "#include <stddef.h>  // offsetof()\n"
                 "\n"
                 "#ifdef __cplusplus\n"
                 "extern \"C\" {\n"
                 "#endif\n"
                 "\n");
 
+        // the variants of a program follow the program
         begin_enum(wc);
-        for (int i = 0; i < ctx->desc.numPrograms; i++)
-                add_enum_item_2(wc, "PROGRAM", ctx->desc.programInfo[i].programName);
+        for (int i = 0; i < ctx->desc.numPrograms; i++) {
+                const char *programName = ctx->desc.programInfo[i].programName;
+                const char *axes[MAX_VARIANT_AXES_PER_PROGRAM];
+                int numAxes = get_variant_axes(programName, axes);
+                for (int variant = 0; variant < 1 << numAxes; variant++) {
+                        struct MemoryBuffer name = {0};
+                        variant_name(&name, programName, axes, numAxes, variant);
+                        add_enum_item_2(wc, "PROGRAM", name.data);
+                        teardown_buffer(&name);
+                }
+        }
         add_enum_item(wc, "NUM_PROGRAM_KINDS");
         end_enum(wc);
 
+        if (numVariantAxes > 0) {
+                append_to_buffer_f(&wc->hFile, "// PROGRAM_x + VARIANTBIT_x_A + VARIANTBIT_x_B == PROGRAM_x_A_B\n");
+                begin_enum(wc);
+                for (int i = 0; i < ctx->desc.numPrograms; i++) {
+                        const char *programName = ctx->desc.programInfo[i].programName;
+                        const char *axes[MAX_VARIANT_AXES_PER_PROGRAM];
+                        int numAxes = get_variant_axes(programName, axes);
+                        for (int k = 0; k < numAxes; k++)
+                                append_to_buffer_f(&wc->hFile, INDENT "VARIANTBIT_%s_%s = %d,\n",
+                                                   programName, axes[k], 1 << k);
+                }
+                end_enum(wc);
+        }
+
         begin_enum(wc);
         for (int i = 0; i < ctx->desc.numShaders; i++)
                 add_enum_item_2(wc, "SHADER", ctx->desc.shaderInfo[i].shaderName);
@@ -272,6 +631,21 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
         add_enum_item(wc, "NUM_UNIFORM_KINDS");
         end_enum(wc);
 
+        /* Each variant of a program has its own uniform locations. Those of
+        the programs themselves are at the UNIFORM_ indices, those of the
+        variants follow. */
+        int numUniformLocations = ctx->numProgramUniforms;
+        for (int i = 0; i < ctx->desc.numPrograms; i++) {
+                const char *axes[MAX_VARIANT_AXES_PER_PROGRAM];
+                int numAxes = get_variant_axes(ctx->desc.programInfo[i].programName, axes);
+                for (int j = 0; j < ctx->numProgramUniforms; j++)
+                        if (ctx->programUniforms[j].programIndex == i)
+                                numUniformLocations += (1 << numAxes) - 1;
+        }
+        begin_enum(wc);
+        append_to_buffer_f(&wc->hFile, INDENT "NUM_UNIFORM_LOCATIONS = %d,\n", numUniformLocations);
+        end_enum(wc);
+
         begin_enum(wc);
         for (int i = 0; i < ctx->numProgramAttributes; i++) {
                 int programIndex = ctx->programAttributes[i].programIndex;
@@ -282,6 +656,22 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
         add_enum_item(wc, "NUM_ATTRIBUTE_KINDS");
         end_enum(wc);
 
+        /* The attribute locations are assigned here, and bound with
+        glBindAttribLocation() before linking. This way they are known at
+        compile time and don't need to be queried after linking. Each program
+        numbers its attributes from 0. */
+        begin_enum(wc);
+        for (int i = 0, location = 0; i < ctx->numProgramAttributes; i++, location++) {
+                int programIndex = ctx->programAttributes[i].programIndex;
+                const char *programName = ctx->desc.programInfo[programIndex].programName;
+                const char *attributeName = ctx->programAttributes[i].attributeName;
+                if (i > 0 && programIndex != ctx->programAttributes[i - 1].programIndex)
+                        location = 0;
+                append_to_buffer_f(&wc->hFile, INDENT "ATTRIBLOCATION_%s_%s = %d,\n",
+                                   programName, attributeName, location);
+        }
+        end_enum(wc);
+
         append_to_buffer_f(&wc->hFile,
                 "extern const struct SM_ShaderInfo smShaderInfo[NUM_SHADER_KINDS];\n"
                 "extern const struct SM_ProgramInfo smProgramInfo[NUM_PROGRAM_KINDS];\n"
@@ -296,9 +686,32 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
         append_to_buffer_f(&wc->cFile, "#include <shaders.h>\n\n");
 
         append_to_buffer_f(&wc->cFile, "const struct SM_ProgramInfo smProgramInfo[NUM_PROGRAM_KINDS] = {\n");
-        for (int i = 0; i < ctx->desc.numPrograms; i++) {
+        for (int i = 0, firstUniform = 0, firstVariantUniform = ctx->numProgramUniforms; i < ctx->desc.numPrograms; i++) {
                 const char *programName = ctx->desc.programInfo[i].programName;
-                append_to_buffer_f(&wc->cFile, INDENT "[PROGRAM_%s] = { \"%s\" },\n", programName, programName);
+                const char *axes[MAX_VARIANT_AXES_PER_PROGRAM];
+                int numAxes = get_variant_axes(programName, axes);
+                int numUniforms = 0;
+                for (int j = 0; j < ctx->numProgramUniforms; j++)
+                        if (ctx->programUniforms[j].programIndex == i)
+                                numUniforms++;
+                for (int variant = 0; variant < 1 << numAxes; variant++) {
+                        struct MemoryBuffer name = {0};
+                        struct MemoryBuffer defines = {0};
+                        variant_name(&name, programName, axes, numAxes, variant);
+                        for (int k = 0; k < numAxes; k++)
+                                append_to_buffer_f(&defines, "#define %s %d\\n", axes[k], (variant >> k) & 1);
+                        int firstUniformLocation = firstUniform;
+                        if (variant > 0) {
+                                firstUniformLocation = firstVariantUniform;
+                                firstVariantUniform += numUniforms;
+                        }
+                        append_to_buffer_f(&wc->cFile, INDENT "[PROGRAM_%s] = { \"%s\", PROGRAM_%s, \"%s\", %d },\n",
+                                           name.data, name.data, programName, defines.data ? defines.data : "",
+                                           firstUniformLocation);
+                        teardown_buffer(&name);
+                        teardown_buffer(&defines);
+                }
+                firstUniform += numUniforms;
         }
         append_to_buffer_f(&wc->cFile, "};\n\n");
 
@@ -312,11 +725,20 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
                         info->shaderName, info->shaderName);
                 {
                         struct MemoryBuffer mb = {0};
-                        text_to_cstring_literal(&mb, "#version 130\n", 13); //XXX
-                        text_to_cstring_literal(&mb, sfa->output, sfa->outputSize);
-                                append_to_buffer_f(&wc->cFile, "SHADER_SOURCE(\n");
-                                append_to_buffer(&wc->cFile, mb.data, mb.length);
-                                append_to_buffer_f(&wc->cFile, "), %s},\n", gp_shadertypeKindString[info->shaderType]);
+                        append_version_line(&mb, find_shader_filepath(info->shaderName));
+                        if (minifyShaders) {
+                                char *text;
+                                int size;
+                                minify_glsl(sfa->output, sfa->outputSize, &text, &size);
+                                text_to_cstring_literal(&mb, text, size);
+                                FREE_MEMORY(&text);
+                        }
+                        else
+                                text_to_cstring_literal(&mb, sfa->output, sfa->outputSize);
+                        append_to_buffer_f(&wc->cFile, "SHADER_SOURCE(\n");
+                        append_to_buffer(&wc->cFile, mb.data, mb.length);
+                        append_to_buffer_f(&wc->cFile, "), %s, \"%s\" },\n", gp_shadertypeKindString[info->shaderType],
+                                           find_shader_filepath(info->shaderName));
                         teardown_buffer(&mb);
                 }
         }
@@ -354,24 +776,21 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
                 const char *attributeName = ctx->programAttributes[i].attributeName;
                 const char *typeName = typeKind_to_GRAFIKATTRTYPE[typeKind];
                 GP_ENSURE(typeName != NULL);
-                append_to_buffer_f(&wc->cFile, INDENT "[ATTRIBUTE_%s_%s] = { PROGRAM_%s, %s, \"%s\" },\n",
-                        programName, attributeName, programName, typeName, attributeName);
+                append_to_buffer_f(&wc->cFile, INDENT "[ATTRIBUTE_%s_%s] = { PROGRAM_%s, %s, \"%s\", ATTRIBLOCATION_%s_%s },\n",
+                        programName, attributeName, programName, typeName, attributeName,
+                        programName, attributeName);
         }
         append_to_buffer_f(&wc->cFile, "};\n\n");
 
         append_to_buffer_f(&wc->hFile,
-                "extern GfxShader gfxShader[NUM_SHADER_KINDS];\n"
                 "extern GfxProgram gfxProgram[NUM_PROGRAM_KINDS];\n"
-                "extern GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_KINDS];\n"
-                "extern GfxAttributeLocation gfxAttributeLocation[NUM_ATTRIBUTE_KINDS];\n"
+                "extern GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_LOCATIONS];\n"
                 "\n"
         );
 
         append_to_buffer_f(&wc->cFile,
                 "GfxProgram gfxProgram[NUM_PROGRAM_KINDS];\n"
-                "GfxShader gfxShader[NUM_SHADER_KINDS];\n"
-                "GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_KINDS];\n"
-                "GfxAttributeLocation gfxAttributeLocation[NUM_ATTRIBUTE_KINDS];\n"
+                "GfxUniformLocation gfxUniformLocation[NUM_UNIFORM_LOCATIONS];\n"
                 "\n"
         );
 
@@ -384,9 +803,7 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
                 INDENT ".attributeInfo = smAttributeInfo,\n"
                 "\n"
                 INDENT ".gfxProgram = gfxProgram,\n"
-                INDENT ".gfxShader = gfxShader,\n"
                 INDENT ".gfxUniformLocation = gfxUniformLocation,\n"
-                INDENT ".gfxAttributeLocation = gfxAttributeLocation,\n"
                 "\n"
                 INDENT ".numPrograms = NUM_PROGRAM_KINDS,\n"
                 INDENT ".numShaders = NUM_SHADER_KINDS,\n"
@@ -399,21 +816,8 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
         for (int i = 0; i < ctx->numProgramUniforms; i++) {
                 struct GP_ProgramUniform *uniform = &ctx->programUniforms[i];
                 const char *programName = ctx->desc.programInfo[uniform->programIndex].programName;
-                const char *uniformName = uniform->uniformName;
-                append_to_buffer_f(&wc->hFile, "static inline void %sShader_set_%s", programName, uniformName);
-                const char *fmt;
-                switch (uniform->typeKind) {
-                case GP_TYPE_FLOAT: fmt = "(float x) { set_uniform_1f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x); }\n"; break;
-                case GP_TYPE_VEC2: fmt = "(float x, float y) { set_uniform_2f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y); }\n"; break;
-                case GP_TYPE_VEC3: fmt = "(float x, float y, float z) { set_uniform_3f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y, z); }\n"; break;
-                case GP_TYPE_VEC4: fmt = "(float x, float y, float z, float w) { set_uniform_4f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y, z, w); }\n"; break;
-                case GP_TYPE_MAT2: fmt = "(const struct Mat2 *mat) { set_uniform_mat2f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], mat); }\n"; break;
-                case GP_TYPE_MAT3: fmt = "(const struct Mat3 *mat) { set_uniform_mat3f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], mat); }\n"; break;
-                case GP_TYPE_MAT4: fmt = "(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], mat); }\n"; break;
-                case GP_TYPE_SAMPLER2D: continue;  // cannot be set, can it?
-                default: gp_fatal_f("Not implemented!");
-                }
-                append_to_buffer_f(&wc->hFile, fmt, programName, programName, uniformName);
+                append_to_buffer_f(&wc->hFile, "static inline void %sShader_set_%s", programName, uniform->uniformName);
+                write_uniform_setter_tail(wc, uniform);
         }
         append_to_buffer_f(&wc->hFile, "\n\n");
 
@@ -430,32 +834,34 @@ void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath)
                                    programName, attributeName,
                                    typeKind_to_real_type[attr->typeKind]);
         }
+        append_to_buffer_f(&wc->hFile, "\n");
+
+        append_to_buffer_f(&wc->hFile, "#define SET_PACKED_ATTRIBPOINTER(attribKind, attribformatKind, vao, vbo, structType, memberName) \\\n"
+                        INDENT "set_packed_attribpointer((attribKind), (attribformatKind), (vao), (vbo), sizeof (structType), offsetof(structType, memberName), sizeof ((structType *)NULL)->memberName)\n\n");
+        for (int i = 0; i < ctx->numProgramAttributes; i++) {
+                struct GP_ProgramAttribute *attr = &ctx->programAttributes[i];
+                const char *programName = ctx->desc.programInfo[attr->programIndex].programName;
+                const char *attributeName = attr->attributeName;
+                append_to_buffer_f(&wc->hFile, "#define SET_PACKED_ATTRIBPOINTER_%s_%s(vao, vbo, structType, memberName, attribformatKind) SET_PACKED_ATTRIBPOINTER(ATTRIBUTE_%s_%s, (attribformatKind), (vao), (vbo), structType, memberName)\n",
+                                   programName, attributeName,
+                                   programName, attributeName);
+        }
+        append_to_buffer_f(&wc->hFile, "\n");
+
+        write_vertex_structs(wc);
 
         append_to_buffer_f(&wc->hFile,
-                "\n"
                 "\n"
                 "#ifdef __cplusplus\n\n");
         for (int i = 0; i < ctx->numProgramUniforms; i++) {
                 int programIndex = ctx->programUniforms[i].programIndex;
-                int typeKind = ctx->programUniforms[i].typeKind;
                 const char *uniformName = ctx->programUniforms[i].uniformName;
                 const char *programName = ctx->desc.programInfo[programIndex].programName;
                 if (i == 0 || programIndex != ctx->programUniforms[i - 1].programIndex) {
                         append_to_buffer_f(&wc->hFile, "static struct {\n");
                 }
                 append_to_buffer_f(&wc->hFile, INDENT "static inline void set_%s", uniformName);
-                const char *fmt;
-                switch (typeKind) {
-                case GP_TYPE_FLOAT: fmt = "(float x) { set_uniform_1f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x); }\n"; break;
-                case GP_TYPE_VEC2: fmt = "(float x, float y) { set_uniform_2f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y); }\n"; break;
-                case GP_TYPE_VEC3: fmt = "(float x, float y, float z) { set_uniform_3f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y, z); }\n"; break;
-                case GP_TYPE_VEC4: fmt = "(float x, float y, float z, float w) { set_uniform_4f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], x, y, z, w); }\n"; break;
-                case GP_TYPE_MAT2: fmt = "(const struct Mat2 *mat) { set_uniform_mat2f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], &mat->mat[0][0]); }\n"; break;
-                case GP_TYPE_MAT3: fmt = "(const struct Mat3 *mat) { set_uniform_mat3f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], &mat->mat[0][0]); }\n"; break;
-                case GP_TYPE_MAT4: fmt = "(const struct Mat4 *mat) { set_uniform_mat4f(gfxProgram[PROGRAM_%s], gfxUniformLocation[UNIFORM_%s_%s], &mat->mat[0][0]); }\n"; break;
-                default: gp_fatal_f("Not implemented!");
-                }
-                append_to_buffer_f(&wc->hFile, fmt, programName, programName, uniformName);
+                write_uniform_setter_tail(wc, &ctx->programUniforms[i]);
                 if (i + 1 == ctx->numProgramUniforms || programIndex != ctx->programUniforms[i + 1].programIndex)
                         append_to_buffer_f(&wc->hFile, "} %sShader;\n\n", programName);
         }
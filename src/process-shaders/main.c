@@ -1,9 +1,16 @@
 #include <glsl-processor/builder.h>
+#include <segments/trace.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // defined in gen.c
+extern void set_attribute_format(const char *programName, const char *attributeName, const char *formatName);
+extern void set_minify_shaders(int enable);
+extern void add_program_variant_axis(const char *programName, const char *defineName);
+extern void set_shader_filepath(const char *shaderName, const char *filepath);
 extern void write_c_interface(struct GP_Ctx *ctx, const char *autogenDirpath);
 
 static void fatal_f(const char *fmt, ...)
@@ -15,8 +22,26 @@ static void fatal_f(const char *fmt, ...)
         exit(1);
 }
 
+/* All input files are hashed, so we can skip the parsing and generation if
+nothing changed since the last run. The hash of the last run is stored in the
+depfile (see write_depfile()). */
+static const char *inputFiles[64];
+static int numInputFiles;
+static uint64_t inputsHash = 14695981039346656037u;
+
+// FNV-1a
+static void hash_bytes(const void *data, size_t size)
+{
+        const unsigned char *p = data;
+        for (size_t i = 0; i < size; i++) {
+                inputsHash ^= p[i];
+                inputsHash *= 1099511628211u;
+        }
+}
+
 static void add_file(struct GP_Builder *sp, const char *fileID)
 {
+        TRACE_SCOPE("add_file");
         const char *filepath = fileID; // might need better flexibility here
 
         FILE *f = fopen(filepath, "rb");
@@ -36,6 +61,11 @@ static void add_file(struct GP_Builder *sp, const char *fileID)
         if (ferror(f))
                 fatal_f("I/O error while reading from '%s'", filepath);
         fclose(f);
+        if (numInputFiles == sizeof inputFiles / sizeof inputFiles[0])
+                fatal_f("Too many input files");
+        inputFiles[numInputFiles++] = fileID;
+        hash_bytes(fileID, strlen(fileID) + 1);
+        hash_bytes(data, size);
         gp_builder_create_file(sp, fileID, data, size);
 }
 
@@ -43,48 +73,138 @@ static void add_shader_and_file(struct GP_Builder *sp, const char *shaderID, con
 {
         add_file(sp, fileID);
         gp_builder_create_shader(sp, shaderID, fileID, shadertypeKind);
+        set_shader_filepath(shaderID, fileID);
+}
+
+static int file_exists(const char *filepath)
+{
+        FILE *f = fopen(filepath, "rb");
+        if (f == NULL)
+                return 0;
+        fclose(f);
+        return 1;
+}
+
+static uint64_t read_previous_hash(const char *depfilePath)
+{
+        unsigned long long hash = 0;
+        FILE *f = fopen(depfilePath, "rb");
+        if (f == NULL)
+                return 0;
+        if (fscanf(f, "# inputs hash: %llx", &hash) != 1)
+                hash = 0;
+        fclose(f);
+        return hash;
+}
+
+/* Write a make-compatible list of the input files. The Makefile includes it
+to re-run process-shaders only if one of the files changed. Like gcc -MP, we
+add an empty rule for each input, so make doesn't fail when a file goes
+away. */
+static void write_depfile(const char *depfilePath, const char *stampPath)
+{
+        FILE *f = fopen(depfilePath, "wb");
+        if (f == NULL)
+                fatal_f("Failed to open '%s' for writing", depfilePath);
+        fprintf(f, "# inputs hash: %016llx\n", (unsigned long long) inputsHash);
+        fprintf(f, "%s:", stampPath);
+        for (int i = 0; i < numInputFiles; i++)
+                fprintf(f, " \\\n\t%s", inputFiles[i]);
+        fprintf(f, "\n\n");
+        for (int i = 0; i < numInputFiles; i++)
+                fprintf(f, "%s:\n", inputFiles[i]);
+        fflush(f);
+        if (ferror(f))
+                fatal_f("I/O error while writing '%s'", depfilePath);
+        fclose(f);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
         struct GP_Builder builder = {0};
+        int minify = 0;
+
+        START_TRACING("process-shaders-trace.json");
+
+        for (int i = 1; i < argc; i++) {
+                if (!strcmp(argv[i], "--minify"))
+                        minify = 1;
+                else if (argv[i][0] == '-')
+                        fatal_f("Unknown option '%s'", argv[i]);
+        }
 
         // Shader <-> Files is not a 1:1 relation
         add_file(&builder, "glsl/math.inc");
 
 #define VERT(name) add_shader_and_file(&builder, name "_vert", "glsl/" name ".vert", GP_SHADERTYPE_VERTEX)
 #define FRAG(name) add_shader_and_file(&builder, name "_frag", "glsl/" name ".frag", GP_SHADERTYPE_FRAGMENT)
-        VERT("line");
-        FRAG("line");
-        VERT("circle");
-        FRAG("circle");
-        VERT("arc");
-        FRAG("arc");
+        VERT("shape");
+        FRAG("shape");
         VERT("v3");
         FRAG("v3");
+        VERT("composite");
+        FRAG("composite");
+        VERT("tile");
+        FRAG("tile");
+        VERT("text");
+        FRAG("text");
 #undef VERT
 #undef FRAG
 
-        gp_builder_create_program(&builder, "line");
-        gp_builder_create_program(&builder, "circle");
-        gp_builder_create_program(&builder, "arc");
+        gp_builder_create_program(&builder, "shape");
         gp_builder_create_program(&builder, "v3");
+        gp_builder_create_program(&builder, "composite");
+        gp_builder_create_program(&builder, "tile");
+        gp_builder_create_program(&builder, "text");
 
-        gp_builder_create_link(&builder, "line", "line_vert");
-        gp_builder_create_link(&builder, "line", "line_frag");
-        gp_builder_create_link(&builder, "circle", "circle_vert");
-        gp_builder_create_link(&builder, "circle", "circle_frag");
-        gp_builder_create_link(&builder, "arc", "arc_vert");
-        gp_builder_create_link(&builder, "arc", "arc_frag");
+        gp_builder_create_link(&builder, "shape", "shape_vert");
+        gp_builder_create_link(&builder, "shape", "shape_frag");
         gp_builder_create_link(&builder, "v3", "v3_vert");
         gp_builder_create_link(&builder, "v3", "v3_frag");
+        gp_builder_create_link(&builder, "composite", "composite_vert");
+        gp_builder_create_link(&builder, "composite", "composite_frag");
+        gp_builder_create_link(&builder, "tile", "tile_vert");
+        gp_builder_create_link(&builder, "tile", "tile_frag");
+        gp_builder_create_link(&builder, "text", "text_vert");
+        gp_builder_create_link(&builder, "text", "text_frag");
+
+        // storage formats for the generated vertex structs (see ATTRIBFORMAT_ in gfx.h)
+        set_attribute_format("shape", "kind", "UINT8");
+        set_attribute_format("shape", "color", "UNORM8");
+        set_attribute_format("v3", "position", "SNORM16");
+        set_attribute_format("v3", "normal", "SNORM_2_10_10_10_REV");
+        set_attribute_format("v3", "color", "UNORM8");
+        set_attribute_format("text", "color", "UNORM8");
+
+        // permutation axes: macros that are #define'd to 0 or 1 in the shaders
+        add_program_variant_axis("v3", "UNLIT");
+
+        set_minify_shaders(minify);
+        hash_bytes(&minify, sizeof minify);
+
+        // a rebuilt process-shaders might generate different code from the same inputs
+        hash_bytes(__DATE__ " " __TIME__, sizeof __DATE__ " " __TIME__);
+
+        if (inputsHash == read_previous_hash("autogenerated/shaders.d")
+            && file_exists("autogenerated/shaders.h")
+            && file_exists("autogenerated/shaders.c")) {
+                gp_builder_teardown(&builder);
+                return 0;
+        }
 
-        gp_builder_process(&builder);
+        {
+                TRACE_SCOPE("gp_builder_process");
+                gp_builder_process(&builder);
+        }
 
         struct GP_Ctx ctx = {0};
         gp_builder_to_ctx(&builder, &ctx);
-        gp_parse(&ctx);
+        {
+                TRACE_SCOPE("gp_parse");
+                gp_parse(&ctx);
+        }
         write_c_interface(&ctx, "autogenerated/");
+        write_depfile("autogenerated/shaders.d", "autogenerated/shaders.stamp");
         gp_teardown(&ctx);
         gp_builder_teardown(&builder);
 
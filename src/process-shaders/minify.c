@@ -0,0 +1,603 @@
+/* Minification of the shader sources that get embedded in shaders.c. It works
+on the tokens of the preprocessed source (glsl-processor has already resolved
+the #include's, other preprocessor lines are kept as they are):
+
+ - functions and global declarations (uniforms, inputs, constants) that are
+   not referenced are removed.
+ - comments and whitespace are stripped.
+ - constants, parameters and local variables get short names. Names that
+   are visible from the outside (uniforms, inputs, outputs) are kept, and so
+   are the names of functions (see rename_identifiers()).
+
+Everything is done conservatively: declarations that don't have one of the
+simple forms we understand are left alone. */
+
+#include <glsl-processor/defs.h>
+#include <glsl-processor/logging.h>
+#include <glsl-processor/memory.h>
+
+#include <string.h>
+
+enum {
+        GLSLTOKEN_IDENTIFIER,
+        GLSLTOKEN_NUMBER,
+        GLSLTOKEN_PUNCT,
+        GLSLTOKEN_DIRECTIVE,  // a whole preprocessor line
+};
+
+struct GlslToken {
+        int tokenKind;
+        const char *text;
+        int length;
+        const char *replacement;  // new name of an identifier, or NULL
+        int isRemoved;
+};
+
+/* A top-level declaration or function definition, or a preprocessor line. */
+struct GlslItem {
+        int firstToken;
+        int endToken;
+        int nameToken;  // -1 if the item has no name we understand
+        int isRemovable;
+};
+
+struct Minifier {
+        struct GlslToken *tokens;
+        int numTokens;
+        struct GlslItem *items;
+        int numItems;
+        // new names, allocated by us
+        char **names;
+        int numNames;
+};
+
+static const char *const multiCharPunctuators[] = {
+        "<<=", ">>=",
+        "++", "--", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=",
+        "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "^^",
+};
+
+static const char *const typeKeywords[] = {
+        "void", "bool", "int", "uint", "float", "double",
+        "vec2", "vec3", "vec4", "ivec2", "ivec3", "ivec4",
+        "uvec2", "uvec3", "uvec4", "bvec2", "bvec3", "bvec4",
+        "dvec2", "dvec3", "dvec4", "mat2", "mat3", "mat4",
+        "mat2x2", "mat2x3", "mat2x4", "mat3x2", "mat3x3", "mat3x4",
+        "mat4x2", "mat4x3", "mat4x4",
+        "sampler1D", "sampler2D", "sampler3D", "samplerCube",
+        "sampler2DShadow", "sampler2DArray", "isampler2D", "usampler2D",
+};
+
+// Qualifiers that make a global declaration visible from the outside.
+static const char *const interfaceQualifiers[] = {
+        "in", "out", "inout", "uniform", "attribute", "varying",
+        "buffer", "shared", "layout",
+};
+
+// Qualifiers of global declarations that must never be removed.
+static const char *const unremovableQualifiers[] = {
+        "out", "inout", "varying", "buffer", "shared", "layout",
+        "struct", "precision", "invariant",
+};
+
+/* Names that a shortened name must not collide with. Names of built-in
+functions that aren't in the list can't collide, because a name that is
+called anywhere is never renamed. */
+static const char *const reservedNames[] = {
+        "do", "if", "in", "for", "out", "int", "asm", "new",
+        "main", "true", "false", "const", "while", "break", "return",
+        "abs", "acos", "all", "any", "asin", "atan", "ceil", "clamp",
+        "cos", "cross", "dFdx", "dFdy", "degrees", "determinant",
+        "distance", "dot", "equal", "exp", "exp2", "faceforward", "floor",
+        "fract", "fwidth", "inverse", "inversesqrt", "isinf", "isnan",
+        "length", "lessThan", "log", "log2", "max", "min", "mix", "mod",
+        "normalize", "not", "notEqual", "outerProduct", "pow", "radians",
+        "reflect", "refract", "round", "sign", "sin", "smoothstep", "sqrt",
+        "step", "tan", "texelFetch", "texture", "texture2D",
+        "textureSize", "transpose", "trunc",
+};
+
+static int is_in_list(const char *const *list, int length, const char *text, int textLength)
+{
+        for (int i = 0; i < length; i++)
+                if ((int) strlen(list[i]) == textLength && !memcmp(list[i], text, textLength))
+                        return 1;
+        return 0;
+}
+
+#define IS_IN_LIST(list, text, textLength) is_in_list((list), sizeof (list) / sizeof (list)[0], (text), (textLength))
+
+static int is_ident_start(int c)
+{
+        return c == '_' || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+static int is_ident_char(int c)
+{
+        return is_ident_start(c) || ('0' <= c && c <= '9');
+}
+
+static int is_digit(int c)
+{
+        return '0' <= c && c <= '9';
+}
+
+static int token_is(const struct GlslToken *tok, const char *text)
+{
+        return tok->length == (int) strlen(text) && !memcmp(tok->text, text, tok->length);
+}
+
+static int tokens_equal(const struct GlslToken *a, const struct GlslToken *b)
+{
+        return a->length == b->length && !memcmp(a->text, b->text, a->length);
+}
+
+static void add_token(struct Minifier *m, int tokenKind, const char *text, int length)
+{
+        REALLOC_MEMORY(&m->tokens, m->numTokens + 1);
+        struct GlslToken *tok = &m->tokens[m->numTokens++];
+        memset(tok, 0, sizeof *tok);
+        tok->tokenKind = tokenKind;
+        tok->text = text;
+        tok->length = length;
+}
+
+static void tokenize(struct Minifier *m, const char *src, int size)
+{
+        int i = 0;
+        int atLineStart = 1;
+        while (i < size) {
+                int c = src[i];
+                if (c == '\n') {
+                        atLineStart = 1;
+                        i++;
+                        continue;
+                }
+                if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+                        i++;
+                        continue;
+                }
+                if (c == '/' && i + 1 < size && src[i + 1] == '/') {
+                        while (i < size && src[i] != '\n')
+                                i++;
+                        continue;
+                }
+                if (c == '/' && i + 1 < size && src[i + 1] == '*') {
+                        i += 2;
+                        while (i + 1 < size && !(src[i] == '*' && src[i + 1] == '/'))
+                                i++;
+                        i += 2;
+                        continue;
+                }
+                int start = i;
+                if (c == '#' && atLineStart) {
+                        while (i < size && src[i] != '\n') {
+                                if (src[i] == '\\' && i + 1 < size && src[i + 1] == '\n')
+                                        i++;
+                                i++;
+                        }
+                        while (i > start && (src[i - 1] == ' ' || src[i - 1] == '\t' || src[i - 1] == '\r'))
+                                i--;
+                        add_token(m, GLSLTOKEN_DIRECTIVE, src + start, i - start);
+                        continue;
+                }
+                atLineStart = 0;
+                if (is_ident_start(c)) {
+                        while (i < size && is_ident_char(src[i]))
+                                i++;
+                        add_token(m, GLSLTOKEN_IDENTIFIER, src + start, i - start);
+                }
+                else if (is_digit(c) || (c == '.' && i + 1 < size && is_digit(src[i + 1]))) {
+                        int isHex = c == '0' && i + 1 < size && (src[i + 1] == 'x' || src[i + 1] == 'X');
+                        while (i < size) {
+                                int d = src[i];
+                                if (is_ident_char(d) || d == '.')
+                                        i++;
+                                else if ((d == '+' || d == '-') && !isHex && (src[i - 1] == 'e' || src[i - 1] == 'E'))
+                                        i++;
+                                else
+                                        break;
+                        }
+                        add_token(m, GLSLTOKEN_NUMBER, src + start, i - start);
+                }
+                else {
+                        int length = 1;
+                        for (int j = 0; j < sizeof multiCharPunctuators / sizeof multiCharPunctuators[0]; j++) {
+                                int n = (int) strlen(multiCharPunctuators[j]);
+                                if (i + n <= size && !memcmp(src + i, multiCharPunctuators[j], n)) {
+                                        length = n;
+                                        break;
+                                }
+                        }
+                        i += length;
+                        add_token(m, GLSLTOKEN_PUNCT, src + start, length);
+                }
+        }
+}
+
+/* Does the word appear in any of the preprocessor lines? Names that do are
+neither removed nor renamed. */
+static int is_used_in_directive(struct Minifier *m, const char *word, int wordLength)
+{
+        for (int i = 0; i < m->numTokens; i++) {
+                const struct GlslToken *tok = &m->tokens[i];
+                if (tok->tokenKind != GLSLTOKEN_DIRECTIVE)
+                        continue;
+                for (int j = 0; j + wordLength <= tok->length; j++) {
+                        if (memcmp(tok->text + j, word, wordLength))
+                                continue;
+                        if (j > 0 && is_ident_char(tok->text[j - 1]))
+                                continue;
+                        if (j + wordLength < tok->length && is_ident_char(tok->text[j + wordLength]))
+                                continue;
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/* Split the tokens into top-level items and find out which of them may be
+removed if their name is not referenced. */
+static void find_items(struct Minifier *m)
+{
+        int i = 0;
+        while (i < m->numTokens) {
+                struct GlslItem item = { i, i + 1, -1, 0 };
+                if (m->tokens[i].tokenKind == GLSLTOKEN_DIRECTIVE) {
+                        i++;
+                }
+                else {
+                        int braceDepth = 0;
+                        int parenDepth = 0;
+                        int firstParen = -1;
+                        int isFunction = 0;
+                        int hasDirective = 0;
+                        for (; i < m->numTokens; i++) {
+                                const struct GlslToken *tok = &m->tokens[i];
+                                if (tok->tokenKind == GLSLTOKEN_DIRECTIVE) {
+                                        hasDirective = 1;
+                                        continue;
+                                }
+                                if (token_is(tok, "(")) {
+                                        if (braceDepth == 0 && parenDepth == 0 && firstParen == -1)
+                                                firstParen = i;
+                                        parenDepth++;
+                                }
+                                else if (token_is(tok, ")"))
+                                        parenDepth--;
+                                else if (token_is(tok, "{")) {
+                                        if (braceDepth == 0 && parenDepth == 0 && firstParen != -1
+                                            && i > 0 && token_is(&m->tokens[i - 1], ")"))
+                                                isFunction = 1;
+                                        braceDepth++;
+                                }
+                                else if (token_is(tok, "}")) {
+                                        braceDepth--;
+                                        if (braceDepth == 0 && isFunction) {
+                                                i++;
+                                                break;
+                                        }
+                                }
+                                else if (token_is(tok, ";") && braceDepth == 0 && parenDepth == 0) {
+                                        i++;
+                                        break;
+                                }
+                        }
+                        item.endToken = i;
+                        // layout(...) is a qualifier, not the name of a function
+                        if (firstParen > item.firstToken
+                            && m->tokens[firstParen - 1].tokenKind == GLSLTOKEN_IDENTIFIER
+                            && !token_is(&m->tokens[firstParen - 1], "layout")
+                            && (isFunction || token_is(&m->tokens[item.endToken - 1], ";"))) {
+                                // function definition or prototype
+                                item.nameToken = firstParen - 1;
+                                item.isRemovable = !hasDirective && !token_is(&m->tokens[item.nameToken], "main");
+                        }
+                        else if (firstParen == -1) {
+                                // simple declaration: qualifiers and type, then name, then '=', '[' or ';'
+                                int j = item.firstToken;
+                                int isSimple = 1;
+                                while (j < item.endToken && m->tokens[j].tokenKind == GLSLTOKEN_IDENTIFIER) {
+                                        if (IS_IN_LIST(unremovableQualifiers, m->tokens[j].text, m->tokens[j].length))
+                                                isSimple = 0;
+                                        j++;
+                                }
+                                if (j - 2 >= item.firstToken && j < item.endToken
+                                    && (token_is(&m->tokens[j], "=") || token_is(&m->tokens[j], "[") || token_is(&m->tokens[j], ";"))) {
+                                        item.nameToken = j - 1;
+                                        // several declarators are not handled
+                                        for (int k = j; k < item.endToken; k++)
+                                                if (token_is(&m->tokens[k], ","))
+                                                        isSimple = 0;
+                                        item.isRemovable = isSimple && !hasDirective;
+                                }
+                        }
+                }
+                REALLOC_MEMORY(&m->items, m->numItems + 1);
+                m->items[m->numItems++] = item;
+        }
+}
+
+static int is_member_access(struct Minifier *m, int tokenIndex)
+{
+        return tokenIndex > 0 && token_is(&m->tokens[tokenIndex - 1], ".");
+}
+
+static int is_referenced(struct Minifier *m, const struct GlslToken *name)
+{
+        for (int i = 0; i < m->numItems; i++) {
+                const struct GlslItem *item = &m->items[i];
+                // declarations of the same name (overloads, prototypes) don't count
+                if (item->nameToken != -1 && tokens_equal(&m->tokens[item->nameToken], name))
+                        continue;
+                for (int j = item->firstToken; j < item->endToken; j++) {
+                        const struct GlslToken *tok = &m->tokens[j];
+                        if (!tok->isRemoved && tok->tokenKind == GLSLTOKEN_IDENTIFIER
+                            && tokens_equal(tok, name) && !is_member_access(m, j))
+                                return 1;
+                }
+        }
+        return is_used_in_directive(m, name->text, name->length);
+}
+
+static void remove_unreferenced_items(struct Minifier *m)
+{
+        // removing an item can make other items unreferenced
+        int changed = 1;
+        while (changed) {
+                changed = 0;
+                for (int i = 0; i < m->numItems; i++) {
+                        struct GlslItem *item = &m->items[i];
+                        if (!item->isRemovable || m->tokens[item->firstToken].isRemoved)
+                                continue;
+                        if (is_referenced(m, &m->tokens[item->nameToken]))
+                                continue;
+                        for (int j = item->firstToken; j < item->endToken; j++)
+                                m->tokens[j].isRemoved = 1;
+                        changed = 1;
+                }
+        }
+}
+
+static int is_used_as_identifier(struct Minifier *m, const char *name, int length)
+{
+        for (int i = 0; i < m->numTokens; i++)
+                if (m->tokens[i].tokenKind == GLSLTOKEN_IDENTIFIER
+                    && m->tokens[i].length == length && !memcmp(m->tokens[i].text, name, length))
+                        return 1;
+        return is_used_in_directive(m, name, length);
+}
+
+/* Make the n'th short name: a, b, ..., Z, aa, ab, ... */
+static void make_short_name(int n, char *buf)
+{
+        static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+        int len = 0;
+        buf[len++] = chars[n % 52];
+        n /= 52;
+        while (n > 0) {
+                n--;
+                buf[len++] = chars[n % 63];
+                n /= 63;
+        }
+        buf[len] = '\0';
+}
+
+/* Is the name called (followed by '(') anywhere? Function names are not
+renamed: a user function may overload a built-in, and renaming it would
+rename the calls of the built-in too. The same goes for a variable that
+shadows a built-in function. */
+static int is_called(struct Minifier *m, const struct GlslToken *name)
+{
+        for (int i = 0; i + 1 < m->numTokens; i++)
+                if (m->tokens[i].tokenKind == GLSLTOKEN_IDENTIFIER && tokens_equal(&m->tokens[i], name)
+                    && token_is(&m->tokens[i + 1], "("))
+                        return 1;
+        return 0;
+}
+
+static void rename_identifiers(struct Minifier *m)
+{
+        // struct members are accessed with '.', which we don't track
+        for (int i = 0; i < m->numTokens; i++)
+                if (token_is(&m->tokens[i], "struct"))
+                        return;
+
+        // names declared by global in/out/uniform declarations must stay
+        struct GlslToken **interfaceNames = NULL;
+        int numInterfaceNames = 0;
+        for (int i = 0; i < m->numItems; i++) {
+                const struct GlslItem *item = &m->items[i];
+                int isInterface = 0;
+                for (int j = item->firstToken; j < item->endToken; j++)
+                        if (m->tokens[j].tokenKind == GLSLTOKEN_IDENTIFIER
+                            && IS_IN_LIST(interfaceQualifiers, m->tokens[j].text, m->tokens[j].length))
+                                isInterface = 1;
+                if (!isInterface || m->tokens[item->firstToken].tokenKind == GLSLTOKEN_DIRECTIVE)
+                        continue;
+                // only global declarations have interface qualifiers; function parameters are inside parens
+                if (item->nameToken != -1 && token_is(&m->tokens[item->nameToken + 1], "("))
+                        continue;
+                for (int j = item->firstToken; j < item->endToken; j++) {
+                        if (m->tokens[j].tokenKind != GLSLTOKEN_IDENTIFIER)
+                                continue;
+                        REALLOC_MEMORY(&interfaceNames, numInterfaceNames + 1);
+                        interfaceNames[numInterfaceNames++] = &m->tokens[j];
+                }
+        }
+
+        // collect declared names: identifiers that directly follow a type
+        struct Renamed {
+                const struct GlslToken *name;
+                int count;
+        } *renamed = NULL;
+        int numRenamed = 0;
+        for (int i = 0; i + 1 < m->numTokens; i++) {
+                const struct GlslToken *type = &m->tokens[i];
+                const struct GlslToken *name = &m->tokens[i + 1];
+                if (type->isRemoved || type->tokenKind != GLSLTOKEN_IDENTIFIER
+                    || !IS_IN_LIST(typeKeywords, type->text, type->length))
+                        continue;
+                if (name->tokenKind != GLSLTOKEN_IDENTIFIER
+                    || IS_IN_LIST(typeKeywords, name->text, name->length)
+                    || IS_IN_LIST(reservedNames, name->text, name->length)
+                    || (name->length >= 3 && !memcmp(name->text, "gl_", 3)))
+                        continue;
+                int skip = 0;
+                for (int j = 0; j < numInterfaceNames; j++)
+                        if (tokens_equal(interfaceNames[j], name))
+                                skip = 1;
+                for (int j = 0; j < numRenamed; j++)
+                        if (tokens_equal(renamed[j].name, name))
+                                skip = 1;
+                if (skip || is_called(m, name) || is_used_in_directive(m, name->text, name->length))
+                        continue;
+                REALLOC_MEMORY(&renamed, numRenamed + 1);
+                renamed[numRenamed].name = name;
+                renamed[numRenamed].count = 0;
+                numRenamed++;
+        }
+        for (int i = 0; i < m->numTokens; i++) {
+                if (m->tokens[i].isRemoved || is_member_access(m, i))
+                        continue;
+                for (int j = 0; j < numRenamed; j++)
+                        if (tokens_equal(&m->tokens[i], renamed[j].name))
+                                renamed[j].count++;
+        }
+
+        // the most frequently used names get the shortest new names
+        for (int i = 1; i < numRenamed; i++) {
+                struct Renamed r = renamed[i];
+                int j = i;
+                for (; j > 0 && renamed[j - 1].count < r.count; j--)
+                        renamed[j] = renamed[j - 1];
+                renamed[j] = r;
+        }
+
+        int n = 0;
+        for (int i = 0; i < numRenamed; i++) {
+                char buf[16];
+                for (;;) {
+                        make_short_name(n++, buf);
+                        int length = (int) strlen(buf);
+                        if (!IS_IN_LIST(reservedNames, buf, length)
+                            && !IS_IN_LIST(typeKeywords, buf, length)
+                            && !is_used_as_identifier(m, buf, length))
+                                break;
+                }
+                // don't make names longer
+                if ((int) strlen(buf) >= renamed[i].name->length)
+                        continue;
+                char *newName = NULL;
+                ALLOC_MEMORY(&newName, strlen(buf) + 1);
+                memcpy(newName, buf, strlen(buf) + 1);
+                REALLOC_MEMORY(&m->names, m->numNames + 1);
+                m->names[m->numNames++] = newName;
+                // copy, since the token that holds the old name gets a replacement too
+                struct GlslToken oldName = *renamed[i].name;
+                for (int j = 0; j < m->numTokens; j++) {
+                        struct GlslToken *tok = &m->tokens[j];
+                        if (tok->tokenKind == GLSLTOKEN_IDENTIFIER && tokens_equal(tok, &oldName)
+                            && !is_member_access(m, j))
+                                tok->replacement = newName;
+                }
+        }
+
+        FREE_MEMORY(&interfaceNames);
+        FREE_MEMORY(&renamed);
+}
+
+static const char *token_text(const struct GlslToken *tok, int *length)
+{
+        if (tok->replacement) {
+                *length = (int) strlen(tok->replacement);
+                return tok->replacement;
+        }
+        *length = tok->length;
+        return tok->text;
+}
+
+/* Do the tokens need a space between them to be read back as the same tokens? */
+static int needs_space(const struct GlslToken *a, const struct GlslToken *b)
+{
+        int aLength, bLength;
+        const char *aText = token_text(a, &aLength);
+        const char *bText = token_text(b, &bLength);
+        char x = aText[aLength - 1];
+        char y = bText[0];
+        if (is_ident_char(x) && is_ident_char(y))
+                return 1;
+        if (x == '/' && (y == '/' || y == '*'))
+                return 1;
+        // e.g. "a - -b" and "a < <=" must not become "a--b" and "a<<=b"
+        for (int i = 0; i < sizeof multiCharPunctuators / sizeof multiCharPunctuators[0]; i++)
+                if (multiCharPunctuators[i][0] == x && multiCharPunctuators[i][1] == y)
+                        return 1;
+        return 0;
+}
+
+static void append_text(char **buf, int *length, const char *text, int textLength)
+{
+        REALLOC_MEMORY(buf, *length + textLength + 1);
+        memcpy(*buf + *length, text, textLength);
+        *length += textLength;
+        (*buf)[*length] = '\0';
+}
+
+/* Minify the GLSL source. The result is allocated with ALLOC_MEMORY() and
+must be freed by the caller. */
+void minify_glsl(const char *src, int size, char **outText, int *outSize)
+{
+        struct Minifier minifier = { 0 };
+        struct Minifier *m = &minifier;
+        tokenize(m, src, size);
+        find_items(m);
+        remove_unreferenced_items(m);
+        rename_identifiers(m);
+
+        enum { MAX_LINE_LENGTH = 100 };  // line breaks don't matter, but they make the output more digestible
+        char *text = NULL;
+        int length = 0;
+        int lineLength = 0;
+        const struct GlslToken *prev = NULL;
+        append_text(&text, &length, "", 0);
+        for (int i = 0; i < m->numTokens; i++) {
+                const struct GlslToken *tok = &m->tokens[i];
+                if (tok->isRemoved)
+                        continue;
+                int tokLength;
+                const char *tokText = token_text(tok, &tokLength);
+                if (tok->tokenKind == GLSLTOKEN_DIRECTIVE) {
+                        if (length > 0 && text[length - 1] != '\n')
+                                append_text(&text, &length, "\n", 1);
+                        append_text(&text, &length, tokText, tokLength);
+                        append_text(&text, &length, "\n", 1);
+                        lineLength = 0;
+                        prev = NULL;
+                        continue;
+                }
+                if (prev) {
+                        if (lineLength + tokLength > MAX_LINE_LENGTH) {
+                                append_text(&text, &length, "\n", 1);
+                                lineLength = 0;
+                        }
+                        else if (needs_space(prev, tok)) {
+                                append_text(&text, &length, " ", 1);
+                                lineLength++;
+                        }
+                }
+                append_text(&text, &length, tokText, tokLength);
+                lineLength += tokLength;
+                prev = tok;
+        }
+        if (length > 0 && text[length - 1] != '\n')
+                append_text(&text, &length, "\n", 1);
+
+        for (int i = 0; i < m->numNames; i++)
+                FREE_MEMORY(&m->names[i]);
+        FREE_MEMORY(&m->names);
+        FREE_MEMORY(&m->tokens);
+        FREE_MEMORY(&m->items);
+        *outText = text;
+        *outSize = length;
+}
@@ -0,0 +1,26 @@
+#include <segments/clock.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+
+uint64_t get_time_ns(void)
+{
+        static LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        if (frequency.QuadPart == 0)
+                QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+        uint64_t rest = counter.QuadPart % frequency.QuadPart;
+        return seconds * 1000000000 + rest * 1000000000 / frequency.QuadPart;
+}
+#else
+#include <time.h>
+
+uint64_t get_time_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
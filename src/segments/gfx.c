@@ -4,9 +4,18 @@
 #include <segments/window.h>
 #include <segments/opengl.h>
 #include <segments/gfx.h>
+#include <segments/clock.h>
+#include <segments/programcache.h>
+#include <segments/shaderreload.h>
+#include <segments/gldebug.h>
+#include <segments/trace.h>
+#include <segments/font.h>
+#include <segments/upload.h>
 #include <shaders.h>
 
 #include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,46 +27,65 @@
 #include <segments/openglprocs.h>
 #undef MAKE
 
-struct LineVertex {
-        struct Vec2 position;
-        struct Vec2 normal;
-        struct Vec3 color;
+enum {
+        SHAPE_LINE,  // keep in sync with glsl/shape.vert and glsl/shape.frag
+        SHAPE_CIRCLE,
+        SHAPE_ARC,
 };
 
-struct CircleVertex {
-        struct Vec2 centerPoint;
-        struct Vec2 diff;
-        struct Vec3 color;
-        float radius;
-};
+/* The vertex structs (struct shapeVertex, struct v3Vertex) are generated
+from the shader attributes, see autogenerated/shaders.h.
+
+All committed 2D primitives go into a single instance stream which is drawn
+with a single instanced draw call (into the shape cache, see
+update_shape_cache()). The preview that follows the mouse is a separate,
+small instance stream. The meaning of the members depends on the kind:
+        SHAPE_LINE: p and q are the end points, radius is half the line width
+        SHAPE_CIRCLE: p is the center point
+        SHAPE_ARC: p is the start point, q the center point
+
+Mesh coordinates must be within [-1,1]. */
+
 
-struct ArcVertex {
-        struct Vec2 startPoint;
-        struct Vec2 centerPoint;
-        struct Vec2 position;
-        struct Vec3 color;
-        float diffAngle;
-        float radius;
+static struct shapeVertex *shapeInstances;
+static struct v3Vertex *v3Vertices;
+
+static int numShapeInstances;
+static int shapeInstancesChanged;
+static int numShapeInstancesUploaded;  // to shapeVBO
+static int shapeVBOCapacity;
+static struct Vec2 shapesMin = { INFINITY, INFINITY };  // bounding box of all shapes
+static struct Vec2 shapesMax = { -INFINITY, -INFINITY };
+static int numV3Vertices;
+static int v3VerticesChanged;
+
+enum {
+        MESH_SPHERE,
+        MESH_TORUS,
+        NUM_MESH_KINDS,
 };
 
-struct V3Vertex {
-        struct Vec3 position;
-        struct Vec3 normal;
-        struct Vec3 color;
+#define NUM_LOD_LEVELS 4
+
+struct MeshLevel {
+        int isGenerated;
+        int firstVertex;
+        int numVertices;
 };
 
+static struct MeshLevel meshLevels[NUM_MESH_KINDS][NUM_LOD_LEVELS];
 
-static struct LineVertex *lineVertices;
-static struct CircleVertex *circleVertices;
-static struct ArcVertex *arcVertices;
-static struct V3Vertex *v3Vertices;
+// meshes that are drawn each frame
+static const int sceneMeshKinds[] = {
+        MESH_TORUS,
+        //MESH_SPHERE,
+};
 
-static int numLineVertices;
-static int numCircleVertices;
-static int numArcVertices;
-static int numV3Vertices;
+// a mesh that is at least this large (radius, in pixels) gets full detail
+static const float lodFullDetailPixels = 128.f;
 
 static int obtuseArcAngle;
+static int sceneIsUnlit;  // toggled with Enter, selects a variant of the v3 program
 static float currentX;
 static float currentY;
 static float arcX;
@@ -74,6 +102,138 @@ static float mouseY;
 static int windowWidth;
 static int windowHeight;
 
+/* Damage tracking: only the part of the window that changed since the back
+buffer was last drawn gets redrawn. The back buffer can be a few frames old
+(see get_back_buffer_age()), so the damage of the last frames is kept. With
+MSAA, the multisampled framebuffer is always one frame old, and the damage of
+the older frames only needs to be resolved into the back buffer. */
+struct Rect {
+        int x0;  // in pixels from the bottom left, x1 and y1 are exclusive
+        int y0;
+        int x1;
+        int y1;
+};
+
+enum {
+        MAX_DAMAGE_AGE = 4,
+};
+
+static struct Rect damageHistory[MAX_DAMAGE_AGE];  // damageHistory[i] is the damage of i frames ago
+static struct Rect lastPreviewRect;
+static struct Mat4 lastScreenTransform;
+static int lastV3Program = -1;
+static int numShapesInLastFrame;
+static int windowIsDamaged = 1;  // everything needs to be redrawn
+
+/* The scene is drawn into a multisampled framebuffer, which is resolved into
+the window's back buffer once per frame. The window itself is single
+sampled, so the number of samples can be changed (with F2) without creating
+a new window. With 0 samples, the scene is drawn into the window directly. */
+static const int msaaSampleChoices[] = { 0, 2, 4, 8 };
+static int msaaSamples = 4;
+static int maxMsaaSamples;
+static int msaaBufferSamples;  // what the buffers were allocated with
+static int msaaBufferWidth;
+static int msaaBufferHeight;
+static GLuint msaaFBO;
+static GLuint msaaColorTexture;
+static GLuint msaaDepthTexture;
+
+/* Dynamic resolution: the scene (the cached shapes, the preview and the 3D
+scene) is drawn at a fraction of the window size when the GPU can't keep up,
+and upscaled to the window with a filtered blit. The GPU time of the frames
+is measured with timer queries, which are read a few frames later so we never
+wait for the GPU. Only frames that were redrawn completely are measured,
+partial redraws say little about what a full frame costs. F3 turns it off. */
+static const float renderScaleSteps[] = { 1.f, 0.85f, 0.7f, 0.6f, 0.5f };
+static int renderScaleStep;
+static int haveDynamicResolution;
+static float frameBudgetMs = 1000.f / 60.f;
+static float gpuFrameMs;  // smoothed GPU time of full frames at the current scale
+static int numFrameTimesAtScale;
+static int renderWidth;  // the size that the scene is drawn at
+static int renderHeight;
+static int scaledBufferWidth;
+static int scaledBufferHeight;
+static GLuint scaledFBO;  // single sampled, what gets upscaled
+static GLuint scaledColorTexture;
+static GLuint scaledDepthTexture;
+
+enum {
+        NUM_FRAME_TIMERS = 4,
+        MIN_FRAME_TIMES_AT_SCALE = 20,  // before the scale is changed again
+};
+
+static GLuint frameTimerQuery[NUM_FRAME_TIMERS];
+static int frameTimerIsPending[NUM_FRAME_TIMERS];
+static int frameTimerIsFullFrame[NUM_FRAME_TIMERS];
+static int nextFrameTimer;
+
+/* The performance HUD (F1, or SEGMENTS_HUD=1 to show it from the start):
+a graph of the last frame times and the GPU times, the times and the
+get_gfx_stats() counts of the last frame. The background, the graph and the
+text are rectangles, which are all drawn with the text program in a single
+draw call. The font atlas has a solid cell for the plain ones. The
+HUD is drawn into the window after the scene was resolved and upscaled, so
+it always has full resolution. Positions are in window pixels from the top
+left. */
+enum {
+        HUD_SCALE = 2,  // window pixels per font pixel
+        HUD_CELL_WIDTH = FONT_GLYPH_WIDTH + 1,  // a glyph and a blank column and row in the atlas
+        HUD_CELL_HEIGHT = FONT_GLYPH_HEIGHT + 1,
+        HUD_SOLID_CELL = NUM_FONT_GLYPHS,  // the cell after the glyphs
+        HUD_ATLAS_COLUMNS = 16,
+        HUD_ATLAS_ROWS = (NUM_FONT_GLYPHS + 1 + HUD_ATLAS_COLUMNS - 1) / HUD_ATLAS_COLUMNS,
+        HUD_ATLAS_WIDTH = HUD_ATLAS_COLUMNS * HUD_CELL_WIDTH,
+        HUD_ATLAS_HEIGHT = HUD_ATLAS_ROWS * HUD_CELL_HEIGHT,
+        HUD_COLUMNS = 48,  // characters per line
+        HUD_LINES = 4,
+        HUD_LINE_HEIGHT = (FONT_GLYPH_HEIGHT + 2) * HUD_SCALE,
+        HUD_MARGIN = 8,
+        HUD_GRAPH_LENGTH = 120,  // frames
+        HUD_GRAPH_BAR_WIDTH = 4,
+        HUD_GRAPH_HEIGHT = 64,  // for twice the frame budget
+        HUD_GRAPH_Y = 2 * HUD_MARGIN + HUD_LINES * HUD_LINE_HEIGHT,
+        HUD_WIDTH = 2 * HUD_MARGIN + HUD_COLUMNS * HUD_CELL_WIDTH * HUD_SCALE,
+        HUD_HEIGHT = HUD_GRAPH_Y + HUD_GRAPH_HEIGHT + HUD_MARGIN,
+};
+
+static int hudIsVisible;
+static int hudWasVisible;  // in the last frame. Its pixels need a redraw when it goes away.
+static GLuint hudFontTexture;
+static GLuint hudVBO;
+static GLuint hudVAO;
+static struct textVertex *hudVertices;
+static int numHudVertices;
+static float hudFrameMs[HUD_GRAPH_LENGTH];  // from the start of a frame to the start of the next
+static float hudGpuMs[HUD_GRAPH_LENGTH];  // arrive a few frames late, see collect_frame_times()
+static int hudFramePos;  // where the next time goes
+static int hudGpuPos;
+static float hudCpuMs;  // of the last frame, without waiting in swap_buffers()
+static float hudSwapMs;
+static float hudDrawMs;  // what drawing the HUD itself cost on the CPU
+static uint64_t hudLastFrameStartNs;
+
+/* Late latching: the mouse position for the preview is queried again right
+before the preview is uploaded, so the preview is closer to where the pointer
+is than the last mousemove event. SEGMENTS_LATE_LATCH=0 turns it off.
+
+SEGMENTS_LATENCY_REPORT=seconds measures the time from input to the return
+of swap_buffers() and logs percentiles of it at that interval. The display
+adds at least a refresh to that. The input time is when the first input
+event of the frame was fetched, or when the mouse position was latched. */
+enum {
+        MAX_LATENCY_SAMPLES = 1024,  // the last ones are kept
+};
+
+static int haveLateLatch = 1;
+static float latencyReportInterval;  // 0 if not measuring
+static uint64_t lastLatencyReportNs;
+static float eventLatencyMs[MAX_LATENCY_SAMPLES];
+static float latchLatencyMs[MAX_LATENCY_SAMPLES];
+static int numEventLatencies;
+static int numLatchLatencies;
+
 static const struct Vec3 lineColor = { 0.4f, 0.8f, 0.8f };
 
 static struct Vec2 sub(struct Vec2 p, struct Vec2 q)
@@ -175,30 +335,49 @@ static struct Mat4 mat4_mul(struct Mat4 a, struct Mat4 b)
         return result;
 }
 
-#if 0
-static void push_triangle(struct Vec2 p, struct Vec2 q, struct Vec2 r)
+static float clamp(float x, float min, float max)
 {
-        struct LineVertex verts[3] = {
-                { p, {0}, {1,0,0} },
-                { q, {0}, {1,0,0} },
-                { r, {0}, {1,0,0} },
-        };
-        int i = numLineVertices;
-        numLineVertices += 3;
-        REALLOC_MEMORY(&lineVertices, numLineVertices);
-        lineVertices[i + 0] = verts[0];
-        lineVertices[i + 1] = verts[1];
-        lineVertices[i + 2] = verts[2];
+        return x < min ? min : x > max ? max : x;
+}
+
+static short pack_snorm16(float x)
+{
+        return (short) lrintf(clamp(x, -1.f, 1.f) * 32767.f);
+}
+
+static unsigned int pack_snorm10(float x)
+{
+        return (unsigned int) lrintf(clamp(x, -1.f, 1.f) * 511.f) & 0x3ff;
+}
+
+static unsigned char pack_unorm8(float x)
+{
+        return (unsigned char) lrintf(clamp(x, 0.f, 1.f) * 255.f);
+}
+
+static struct Snorm16Vec3 pack_position(struct Vec3 v)
+{
+        return (struct Snorm16Vec3) { pack_snorm16(v.x), pack_snorm16(v.y), pack_snorm16(v.z), 0 };
+}
+
+static Snorm_2_10_10_10_Rev pack_normal(struct Vec3 v)
+{
+        return pack_snorm10(v.x) | pack_snorm10(v.y) << 10 | pack_snorm10(v.z) << 20;
+}
+
+static struct Unorm8Vec4 pack_color(struct Vec3 c)
+{
+        return (struct Unorm8Vec4) { pack_unorm8(c.x), pack_unorm8(c.y), pack_unorm8(c.z), 255 };
 }
-#endif
 
 static void push_triangle_v3(struct Vec3 p, struct Vec3 q, struct Vec3 r,
                           struct Vec3 pn, struct Vec3 qn, struct Vec3 rn, struct Vec3 color)
 {
-        struct V3Vertex verts[3] = {
-                { p, pn, color },
-                { q, qn, color },
-                { r, rn, color },
+        struct Unorm8Vec4 packedColor = pack_color(color);
+        struct v3Vertex verts[3] = {
+                { .position = pack_position(p), .normal = pack_normal(pn), .color = packedColor },
+                { .position = pack_position(q), .normal = pack_normal(qn), .color = packedColor },
+                { .position = pack_position(r), .normal = pack_normal(rn), .color = packedColor },
         };
         int i = numV3Vertices;
         numV3Vertices += 3;
@@ -208,53 +387,129 @@ static void push_triangle_v3(struct Vec3 p, struct Vec3 q, struct Vec3 r,
         v3Vertices[i + 2] = verts[2];
         /*
         message_f("Triangle %f,%f,%f  %f,%f,%f  %f,%f,%f",
-                  verts[0].position.x, verts[0].position.y, verts[0].position.z,
-                  verts[1].position.x, verts[1].position.y, verts[1].position.z,
-                  verts[2].position.x, verts[2].position.y, verts[2].position.z);
+                  p.x, p.y, p.z,
+                  q.x, q.y, q.z,
+                  r.x, r.y, r.z);
                   */
 }
 
-void add_line(float x1, float y1, float x2, float y2)
+static void get_shape_bounds(const struct shapeVertex *shape, struct Vec2 *outMin, struct Vec2 *outMax)
 {
-	struct Vec2 n = { x2 - x1, y2 - y1 };
-	n = normalize(n);
-	float dx = n.x / 128.f;
-	float dy = n.y / 128.f;
-
-        struct LineVertex verts[6] = {
-                {{ x1, y1}, { dy, -dx }, lineColor, },
-                {{ x1, y1}, { -dy, dx }, lineColor, },
-                {{ x2, y2}, { dy, -dx }, lineColor, },
-                {{ x1, y1}, { -dy, dx }, lineColor, },
-                {{ x2, y2}, { dy, -dx }, lineColor, },
-                {{ x2, y2}, { -dy, dx }, lineColor, },
-        };
+        // arcs are within the circle around q, the other shapes around p (and q)
+        struct Vec2 points[2] = { shape->p, shape->kind == SHAPE_CIRCLE ? shape->p : shape->q };
+        *outMin = (struct Vec2) { INFINITY, INFINITY };
+        *outMax = (struct Vec2) { -INFINITY, -INFINITY };
+        for (int i = shape->kind == SHAPE_ARC; i < 2; i++) {
+                outMin->x = fminf(outMin->x, points[i].x - shape->radius);
+                outMin->y = fminf(outMin->y, points[i].y - shape->radius);
+                outMax->x = fmaxf(outMax->x, points[i].x + shape->radius);
+                outMax->y = fmaxf(outMax->y, points[i].y + shape->radius);
+        }
+}
+
+/* The shapes are binned by their bounds on a grid of squares of size
+1 / SHAPE_BINS_PER_UNIT, so that a tile can find the shapes that it
+overlaps. The grid is unbounded and hashed into a fixed number of bins, so a
+bin can hold shapes of several squares. Shapes that would go into more than
+MAX_BINS_PER_SHAPE squares are kept in a separate list instead. */
+enum {
+        SHAPE_BINS_PER_UNIT = 16,
+        NUM_SHAPE_BINS = 4096,
+        MAX_BINS_PER_SHAPE = 16,
+};
+
+struct ShapeBin {
+        int *shapes;  // indices into shapeInstances, ascending
+        int numShapes;
+        int lastGatheredPass;
+};
+
+static struct ShapeBin shapeBins[NUM_SHAPE_BINS];
+static int *largeShapes;
+static int numLargeShapes;
 
-        int idx = numLineVertices;
-        numLineVertices += 6;
-        REALLOC_MEMORY(&lineVertices, numLineVertices);
-        COPY_MEMORY(lineVertices + idx, verts, LENGTH(verts));
+static int get_shape_bin(int x, int y)
+{
+        unsigned h = (unsigned) x * 73856093u ^ (unsigned) y * 19349663u;
+        return (int) (h % NUM_SHAPE_BINS);
 }
 
-void add_circle(float x, float y)
+static void get_shape_bin_range(struct Vec2 min, struct Vec2 max, int *x0, int *y0, int *x1, int *y1)
+{
+        *x0 = (int) floorf(min.x * SHAPE_BINS_PER_UNIT);
+        *y0 = (int) floorf(min.y * SHAPE_BINS_PER_UNIT);
+        *x1 = (int) floorf(max.x * SHAPE_BINS_PER_UNIT);
+        *y1 = (int) floorf(max.y * SHAPE_BINS_PER_UNIT);
+}
+
+static void add_to_shape_bin(struct ShapeBin *bin, int idx)
+{
+        // a shape can hash to the same bin from several squares
+        if (bin->numShapes > 0 && bin->shapes[bin->numShapes - 1] == idx)
+                return;
+        REALLOC_MEMORY(&bin->shapes, bin->numShapes + 1);
+        bin->shapes[bin->numShapes++] = idx;
+}
+
+static void bin_shape(int idx, struct Vec2 min, struct Vec2 max)
+{
+        float w = floorf(max.x * SHAPE_BINS_PER_UNIT) - floorf(min.x * SHAPE_BINS_PER_UNIT) + 1.f;
+        float h = floorf(max.y * SHAPE_BINS_PER_UNIT) - floorf(min.y * SHAPE_BINS_PER_UNIT) + 1.f;
+        if (!(w * h <= MAX_BINS_PER_SHAPE)) {
+                REALLOC_MEMORY(&largeShapes, numLargeShapes + 1);
+                largeShapes[numLargeShapes++] = idx;
+                return;
+        }
+        int x0, y0, x1, y1;
+        get_shape_bin_range(min, max, &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                        add_to_shape_bin(&shapeBins[get_shape_bin(x, y)], idx);
+}
+
+static void push_shape(struct shapeVertex shape)
+{
+        int idx = numShapeInstances;
+        numShapeInstances += 1;
+        REALLOC_MEMORY(&shapeInstances, numShapeInstances);
+        shapeInstances[idx] = shape;
+        shapeInstancesChanged = 1;
+        struct Vec2 min, max;
+        get_shape_bounds(&shape, &min, &max);
+        shapesMin.x = fminf(shapesMin.x, min.x);
+        shapesMin.y = fminf(shapesMin.y, min.y);
+        shapesMax.x = fmaxf(shapesMax.x, max.x);
+        shapesMax.y = fmaxf(shapesMax.y, max.y);
+        bin_shape(idx, min, max);
+}
+
+static struct shapeVertex make_line(float x1, float y1, float x2, float y2)
 {
-        float d = 1.0 / 32.0f;
-        struct CircleVertex verts[6] = {
-                {{ x, y }, { -1.0, -1.0 }, lineColor, d },
-                {{ x, y }, { -1.0, 1.0 }, lineColor, d },
-                {{ x, y }, { 1.0, 1.0 }, lineColor, d },
-                {{ x, y }, { 1.0, 1.0 }, lineColor, d },
-                {{ x, y }, { 1.0, -1.0 }, lineColor, d },
-                {{ x, y }, { -1.0, -1.0 }, lineColor, d },
+        return (struct shapeVertex) {
+                .kind = SHAPE_LINE,
+                .p = { x1, y1 },
+                .q = { x2, y2 },
+                .radius = 1.f / 128.f,
+                .color = pack_color(lineColor),
         };
+}
 
-        int idx = numCircleVertices;
-        numCircleVertices += 6;
-        REALLOC_MEMORY(&circleVertices, numCircleVertices);
-        COPY_MEMORY(circleVertices + idx, verts, LENGTH(verts));
+void add_line(float x1, float y1, float x2, float y2)
+{
+        push_shape(make_line(x1, y1, x2, y2));
 }
 
-void add_arc(struct Vec2 p, struct Vec2 q, struct Vec2 r)
+void add_circle(float x, float y)
+{
+        push_shape((struct shapeVertex) {
+                .kind = SHAPE_CIRCLE,
+                .p = { x, y },
+                .radius = 1.f / 32.f,
+                .color = pack_color(lineColor),
+        });
+}
+
+static struct shapeVertex make_arc(struct Vec2 p, struct Vec2 q, struct Vec2 r)
 {
         struct Vec2 qp = sub(p, q);
         struct Vec2 qr = sub(r, q);
@@ -266,19 +521,19 @@ void add_arc(struct Vec2 p, struct Vec2 q, struct Vec2 r)
                 diffAngle = -diffAngle;
 
         float radius = length(qp);
-        struct ArcVertex verts[6] = {
-                {p, q, { q.x - radius, q.y - radius }, lineColor, diffAngle, radius },
-                {p, q, { q.x - radius, q.y + radius }, lineColor, diffAngle, radius },
-                {p, q, { q.x + radius, q.y + radius }, lineColor, diffAngle, radius },
-                {p, q, { q.x + radius, q.y + radius }, lineColor, diffAngle, radius },
-                {p, q, { q.x + radius, q.y - radius }, lineColor, diffAngle, radius },
-                {p, q, { q.x - radius, q.y - radius }, lineColor, diffAngle, radius },
+        return (struct shapeVertex) {
+                .kind = SHAPE_ARC,
+                .p = p,
+                .q = q,
+                .radius = radius,
+                .diffAngle = diffAngle,
+                .color = pack_color(lineColor),
         };
+}
 
-        int idx = numArcVertices;
-        numArcVertices += 6;
-        REALLOC_MEMORY(&arcVertices, numArcVertices);
-        COPY_MEMORY(arcVertices + idx, verts, LENGTH(verts));
+void add_arc(struct Vec2 p, struct Vec2 q, struct Vec2 r)
+{
+        push_shape(make_arc(p, q, r));
 }
 
 void move_to(float x, float y)
@@ -292,33 +547,58 @@ void move_to(float x, float y)
 void line_to(float x, float y)
 {
         add_line(currentX, currentY, x, y);
-        add_circle(x, y);
         arcX = currentX;
         arcY = currentY;
         currentX = x;
         currentY = y;
 }
 
-static void make_sphere(void)
+/* Tessellation of the procedural meshes for each level of detail. Level 0
+is the finest, each following level roughly halves the number of steps. */
+static const struct {
+        int circlePoints;
+        int circleSteps;
+} sphereTessellation[NUM_LOD_LEVELS] = {
+        { 60, 10 },
+        { 30, 6 },
+        { 16, 4 },
+        { 8, 2 },
+};
+
+static const struct {
+        int ringPoints;
+        int steps;
+        int arrowSteps;
+} torusTessellation[NUM_LOD_LEVELS] = {
+        { 30, 60, 10 },
+        { 16, 30, 6 },
+        { 10, 16, 4 },
+        { 6, 8, 2 },
+};
+
+static void make_sphere(int lodLevel)
 {
+        TRACE_SCOPE("make_sphere");
+        int circlePoints = sphereTessellation[lodLevel].circlePoints;
+        int circleSteps = sphereTessellation[lodLevel].circleSteps;
         float radius = 0.5f;
         struct Vec3 circle[60];
-        for (int i = 0; i < LENGTH(circle); i++) {
-                float angle = 2 * M_PI / LENGTH(circle) * i;
+        ENSURE(circlePoints <= LENGTH(circle));
+        for (int i = 0; i < circlePoints; i++) {
+                float angle = 2 * M_PI / circlePoints * i;
                 circle[i] = (struct Vec3) { radius * cosf(angle), 0.f, radius * sinf(angle) };
                 //message_f("circle: %f %f, length(%f)", circle[i].x, circle[i].z, vec3_length(circle[i]));
         }
-#define CIRCLESTEPS 10
-        for (int i = 0; i < CIRCLESTEPS; i++) {
-                float angle1 = M_PI / 2 * i / CIRCLESTEPS;
+        for (int i = 0; i < circleSteps; i++) {
+                float angle1 = M_PI / 2 * i / circleSteps;
                 float sa1 = sinf(angle1);
                 float ca1 = cosf(angle1);
-                float angle2 = M_PI / 2 * (i+1) / CIRCLESTEPS;
+                float angle2 = M_PI / 2 * (i+1) / circleSteps;
                 float sa2 = sinf(angle2);
                 float ca2 = cosf(angle2);
 
-                for (int j = 0; j < LENGTH(circle); j++) {
-                        int k = j ? j - 1 : LENGTH(circle) - 1;
+                for (int j = 0; j < circlePoints; j++) {
+                        int k = j ? j - 1 : circlePoints - 1;
                         struct Vec3 p = circle[j];
                         struct Vec3 q = circle[k];
                         struct Vec3 p1 = { radius * ca1 * p.x, radius * sa1, radius * ca1 * p.z };
@@ -339,29 +619,32 @@ static void make_sphere(void)
         }
 }
 
-static void make_torus(void)
+static void make_torus(int lodLevel)
 {
+        TRACE_SCOPE("make_torus");
+        int ringPoints = torusTessellation[lodLevel].ringPoints;
+        int steps = torusTessellation[lodLevel].steps;
+        int arrowSteps = torusTessellation[lodLevel].arrowSteps;
         float radius = 0.4f;
         float torusDiameter = 0.1f;
         struct Vec3 point = { torusDiameter, 0.0f, 0.0f };
         struct Vec3 normalVector = { 1.0f, 0.0f, 0.0f };
-#define RINGPOINTS 30
-        struct Vec3 ring[RINGPOINTS];
-        struct Vec3 normal[RINGPOINTS];
-        for (int i = 0; i < RINGPOINTS; i++) {
-                float angle = 2 * M_PI / RINGPOINTS * i;
+        struct Vec3 ring[30];
+        struct Vec3 normal[30];
+        ENSURE(ringPoints <= LENGTH(ring));
+        for (int i = 0; i < ringPoints; i++) {
+                float angle = 2 * M_PI / ringPoints * i;
                 ring[i] = vec3_rotate_z(point, angle);
                 ring[i].x += radius;
                 normal[i] = vec3_rotate_z(normalVector, angle);
         }
-#define STEPS 60
-        for (int i = STEPS/2; i <= STEPS; i++) {
+        for (int i = steps/2; i <= steps; i++) {
                 float angle[2] = {
-                        2 * M_PI / STEPS * i,
-                        2 * M_PI / STEPS * (i+1),
+                        2 * M_PI / steps * i,
+                        2 * M_PI / steps * (i+1),
                 };
-                for (int j = 0; j < RINGPOINTS; j++) {
-                        int k = j ? j - 1 : RINGPOINTS - 1;
+                for (int j = 0; j < ringPoints; j++) {
+                        int k = j ? j - 1 : ringPoints - 1;
                         int ri[2] = { j, k };
                         struct Vec3 p[2];
                         struct Vec3 q[2];
@@ -375,7 +658,7 @@ static void make_torus(void)
                                 q[qi] = vec3_rotate_y(ring[ri[qi]], angle[1]);
                                 qn[qi] = vec3_rotate_y(normal[ri[qi]], angle[1]);
                         }
-                        struct Vec3 color = { 0.f, 1.f, (float)i/STEPS };
+                        struct Vec3 color = { 0.f, 1.f, (float)i/steps };
                         //struct Vec3 color = { 0.f, 0.f, 1.f };
                         push_triangle_v3(p[0], q[0], p[1], pn[0], qn[0], pn[1], color);
                         push_triangle_v3(q[0], q[1], p[1], qn[0], qn[1], pn[1], color);
@@ -383,18 +666,17 @@ static void make_torus(void)
         }
 
         // arrow tip
-#define ARROWSTEPS 10
         float arrowStartDiameter = 1.4f * torusDiameter;
         float arrowAngularLength = 1.2f;
-        for (int i = 0; i < ARROWSTEPS; i++) {
+        for (int i = 0; i < arrowSteps; i++) {
                 float angle[2] = {
-                        arrowAngularLength / ARROWSTEPS * i,
-                        arrowAngularLength / ARROWSTEPS * (i + 1),
+                        arrowAngularLength / arrowSteps * i,
+                        arrowAngularLength / arrowSteps * (i + 1),
                 };
-                for (int j = 0; j < RINGPOINTS; j++) {
+                for (int j = 0; j < ringPoints; j++) {
                         float a[2] = {
-                                2 * M_PI / RINGPOINTS * j,
-                                2 * M_PI / RINGPOINTS * (j + 1),
+                                2 * M_PI / ringPoints * j,
+                                2 * M_PI / ringPoints * (j + 1),
                         };
                         struct Vec3 p0[2];
                         for (int k = 0; k < 2; k++) {
@@ -407,7 +689,7 @@ static void make_torus(void)
                         struct Vec3 qn[2] = {0};
                         for (int pi = 0; pi < 2; pi++) {
                                 struct Vec3 P = p0[pi];
-                                float factor = (float) (ARROWSTEPS - i) / ARROWSTEPS;
+                                float factor = (float) (arrowSteps - i) / arrowSteps;
                                 P.x *= factor;
                                 P.y *= factor;
                                 P.x += radius;
@@ -417,7 +699,7 @@ static void make_torus(void)
                         }
                         for (int qi = 0; qi < 2; qi++) {
                                 struct Vec3 P = p0[qi];
-                                float factor = (float) (ARROWSTEPS - i - 1) / ARROWSTEPS;
+                                float factor = (float) (arrowSteps - i - 1) / arrowSteps;
                                 P.x *= factor;
                                 P.y *= factor;
                                 P.x += radius;
@@ -425,7 +707,7 @@ static void make_torus(void)
                                 q[qi] = P;
                                 //qn[qi] = vec3_rotate_y(normal[ri[qi]], angle[1]);
                         }
-                        struct Vec3 color = { 1.f, (float)i/STEPS, 0.f };
+                        struct Vec3 color = { 1.f, (float)i/steps, 0.f };
                         //struct Vec3 color = { 0.f, 0.f, 1.f };
                         push_triangle_v3(p[0], q[0], p[1], pn[0], qn[0], pn[1], color);
                         push_triangle_v3(q[0], q[1], p[1], qn[0], qn[1], pn[1], color);
@@ -433,6 +715,51 @@ static void make_torus(void)
         }
 }
 
+static const struct {
+        void (*make)(int lodLevel);
+        float boundingRadius;
+} meshKindInfo[NUM_MESH_KINDS] = {
+        [MESH_SPHERE] = { make_sphere, 0.25f },
+        [MESH_TORUS] = { make_torus, 0.55f },
+};
+
+/* Returns the vertex range of the given mesh at the given level of detail.
+The levels are generated on first use and stay in v3Vertices afterwards. */
+static const struct MeshLevel *get_mesh_level(int meshKind, int lodLevel)
+{
+        struct MeshLevel *ml = &meshLevels[meshKind][lodLevel];
+        if (!ml->isGenerated) {
+                ml->firstVertex = numV3Vertices;
+                meshKindInfo[meshKind].make(lodLevel);
+                ml->numVertices = numV3Vertices - ml->firstVertex;
+                ml->isGenerated = 1;
+                v3VerticesChanged = 1;
+        }
+        return ml;
+}
+
+/* Chooses the level of detail from the size of the mesh on the screen. The
+3x3 part of screenTransform is a rotation scaled by zoomFactor, so the length
+of any of its columns is the scale from world to clip space. */
+static int select_lod_level(int meshKind)
+{
+        struct Vec3 column = {
+                screenTransform.mat[0][0],
+                screenTransform.mat[1][0],
+                screenTransform.mat[2][0],
+        };
+        float renderSize = renderWidth > renderHeight ? renderWidth : renderHeight;
+        float radiusInPixels = meshKindInfo[meshKind].boundingRadius
+                * vec3_length(column) * 0.5f * renderSize;
+        int lodLevel = 0;
+        float threshold = lodFullDetailPixels;
+        while (lodLevel + 1 < NUM_LOD_LEVELS && radiusInPixels < threshold) {
+                lodLevel++;
+                threshold /= 2;
+        }
+        return lodLevel;
+}
+
 static void compute_screen_transform(void)
 {
         float cx = cosf(viewingAngleX);
@@ -458,6 +785,13 @@ static void compute_screen_transform(void)
         memcpy(&screenTransform, &st, sizeof st);
 }
 
+// x and y in window pixels from the top left
+static void set_mouse_position(float x, float y)
+{
+        mouseX = (2.0f * x / windowWidth) - 1.0f;
+        mouseY = - ((2.0f * y / windowHeight) - 1.0f);
+}
+
 static float add_modulo_2pi(float a, float b)
 {
         ENSURE(0 <= a && a <= 2 * M_PI);
@@ -481,154 +815,528 @@ static float sub_modulo_2pi(float a, float b)
 
 
 
+#ifndef NDEBUG
 static void check_gl_errors(const char *filename, int line)
 {
         GLenum err = glGetError();
         if (err != GL_NO_ERROR)
-                fatal_f("In %s line %d: GL error %s\n", filename, line,
+                fatal_f("In %s line %d: GL error %s", filename, line,
                         gluErrorString(err));
 }
+#endif
+
+/* See struct GfxStats. The counts that other modules keep (reallocs,
+dropped events) are totals, the differences are taken at the end of each
+frame. */
+static struct GfxStats frameStats;
+static struct GfxStats lastFrameStats;
+static uint64_t lastNumReallocs;
+static uint64_t lastNumDroppedEvents;
+static int statsFrameNumber;
+static int statsLimitsFromFrame;
+static int haveStatsLimits;
+static struct GfxStats statsLimits;
+
+static const struct {
+        const char *name;
+        size_t offset;
+} gfxStatsFields[] = {
+        { "drawCalls", offsetof(struct GfxStats, numDrawCalls) },
+        { "programBinds", offsetof(struct GfxStats, numProgramBinds) },
+        { "vaoBinds", offsetof(struct GfxStats, numVaoBinds) },
+        { "vertices", offsetof(struct GfxStats, numVertices) },
+        { "bytesUploaded", offsetof(struct GfxStats, numBytesUploaded) },
+        { "reallocs", offsetof(struct GfxStats, numReallocs) },
+        { "events", offsetof(struct GfxStats, numEvents) },
+        { "droppedEvents", offsetof(struct GfxStats, numDroppedEvents) },
+};
+
+static uint64_t *get_gfx_stats_field(struct GfxStats *stats, int fieldIndex)
+{
+        return (uint64_t *) ((char *) stats + gfxStatsFields[fieldIndex].offset);
+}
+
+void get_gfx_stats(struct GfxStats *stats)
+{
+        *stats = lastFrameStats;
+}
+
+static void setup_gfx_stats(void)
+{
+        for (int i = 0; i < LENGTH(gfxStatsFields); i++)
+                *get_gfx_stats_field(&statsLimits, i) = UINT64_MAX;
+        lastNumReallocs = get_number_of_reallocs();
+        lastNumDroppedEvents = get_number_of_dropped_events();
+        const char *env = getenv("SEGMENTS_STATS_LIMITS");
+        if (env == NULL)
+                return;
+        // name=value,name=value,...
+        for (const char *s = env; *s;) {
+                int len = (int) strcspn(s, "=,");
+                char *end = (char *) s + len;
+                unsigned long long value = 0;
+                if (*end == '=') {
+                        errno = 0;
+                        value = strtoull(end + 1, &end, 10);
+                        if (errno != 0 || (*end != ',' && *end != '\0'))
+                                end = NULL;
+                }
+                else
+                        end = NULL;
+                if (end == NULL) {
+                        LOG_WARNING(LOGCATEGORY_GFX, "Bad SEGMENTS_STATS_LIMITS '%s'", env);
+                        return;
+                }
+                if (len == 4 && !strncmp(s, "from", 4))
+                        statsLimitsFromFrame = (int) value;
+                else {
+                        int i = 0;
+                        while (i < LENGTH(gfxStatsFields)
+                               && (strlen(gfxStatsFields[i].name) != (size_t) len
+                                   || strncmp(s, gfxStatsFields[i].name, len)))
+                                i++;
+                        if (i == LENGTH(gfxStatsFields))
+                                LOG_WARNING(LOGCATEGORY_GFX, "Unknown stat '%.*s' in SEGMENTS_STATS_LIMITS", len, s);
+                        else {
+                                *get_gfx_stats_field(&statsLimits, i) = value;
+                                haveStatsLimits = 1;
+                        }
+                }
+                s = *end == ',' ? end + 1 : end;
+        }
+}
+
+static void end_frame_stats(void)
+{
+        uint64_t numReallocs = get_number_of_reallocs();
+        uint64_t numDroppedEvents = get_number_of_dropped_events();
+        frameStats.numReallocs = numReallocs - lastNumReallocs;
+        frameStats.numDroppedEvents = numDroppedEvents - lastNumDroppedEvents;
+        lastNumReallocs = numReallocs;
+        lastNumDroppedEvents = numDroppedEvents;
+        if (haveStatsLimits && statsFrameNumber >= statsLimitsFromFrame) {
+                for (int i = 0; i < LENGTH(gfxStatsFields); i++) {
+                        uint64_t value = *get_gfx_stats_field(&frameStats, i);
+                        uint64_t limit = *get_gfx_stats_field(&statsLimits, i);
+                        if (value > limit)
+                                fatal_f("Frame %d: %s is %llu, more than the limit of %llu",
+                                        statsFrameNumber, gfxStatsFields[i].name,
+                                        (unsigned long long) value, (unsigned long long) limit);
+                }
+        }
+        LOG_DEBUG(LOGCATEGORY_GFX, "Frame %d: %llu draw calls, %llu program and %llu VAO binds, "
+                  "%llu vertices, %llu bytes uploaded, %llu reallocs, %llu events (%llu dropped)",
+                  statsFrameNumber,
+                  (unsigned long long) frameStats.numDrawCalls,
+                  (unsigned long long) frameStats.numProgramBinds,
+                  (unsigned long long) frameStats.numVaoBinds,
+                  (unsigned long long) frameStats.numVertices,
+                  (unsigned long long) frameStats.numBytesUploaded,
+                  (unsigned long long) frameStats.numReallocs,
+                  (unsigned long long) frameStats.numEvents,
+                  (unsigned long long) frameStats.numDroppedEvents);
+        lastFrameStats = frameStats;
+        memset(&frameStats, 0, sizeof frameStats);
+        statsFrameNumber++;
+}
+
+// unbinding (0) is not counted
+static void use_program(GLuint program)
+{
+        glUseProgram(program);
+        if (program != 0)
+                frameStats.numProgramBinds++;
+}
+
+static void bind_vertex_array(GLuint vao)
+{
+        glBindVertexArray(vao);
+        if (vao != 0)
+                frameStats.numVaoBinds++;
+}
 
 static void set_array_buffer_data(int bufferId, void *data, size_t numElems, size_t elemSize)
 {
+        TRACE_SCOPE("upload");
         glBindBuffer(GL_ARRAY_BUFFER, bufferId);
         glBufferData(GL_ARRAY_BUFFER, numElems * elemSize, data, GL_DYNAMIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        frameStats.numBytesUploaded += numElems * elemSize;
 }
 
-void set_attribpointer(int attribKind, GfxVAO vao, GfxVBO vbo, int stride, int offset)
+/* Upload the elements [numOld, numElems) to a buffer that holds the first
+numOld of them already. The buffer grows by doubling, and only then all
+elements get uploaded again. */
+static void append_array_buffer_data(int bufferId, int *capacity, void *data, int numOld, int numElems, size_t elemSize)
 {
-        static struct {
-                int isSupported;
-                int gl_type;
-                int num;
-        } grafikattrtypeKind_Info[] = {
-#define MAKE(x, y, z) [x] = { 1, y, z }
-        MAKE(GRAFIKATTRTYPE_FLOAT, GL_FLOAT, 1),
-        MAKE(GRAFIKATTRTYPE_VEC2, GL_FLOAT, 2),
-        MAKE(GRAFIKATTRTYPE_VEC3, GL_FLOAT, 3),
-        MAKE(GRAFIKATTRTYPE_VEC4, GL_FLOAT, 4),
+        TRACE_SCOPE("upload");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+        if (numElems > *capacity) {
+                *capacity = *capacity > 0 ? *capacity : 256;
+                while (*capacity < numElems)
+                        *capacity *= 2;
+                glBufferData(GL_ARRAY_BUFFER, *capacity * elemSize, NULL, GL_DYNAMIC_DRAW);
+                numOld = 0;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, numOld * elemSize, (numElems - numOld) * elemSize,
+                        (const char *) data + numOld * elemSize);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        frameStats.numBytesUploaded += (numElems - numOld) * elemSize;
+}
+
+static const struct {
+        int isSupported;
+        int gl_type;
+        int num;
+        int isInteger;
+} grafikattrtypeKind_Info[] = {
+#define MAKE(x, y, z, w) [x] = { 1, y, z, w }
+        MAKE(GRAFIKATTRTYPE_INT, GL_INT, 1, 1),
+        MAKE(GRAFIKATTRTYPE_UINT, GL_UNSIGNED_INT, 1, 1),
+        MAKE(GRAFIKATTRTYPE_FLOAT, GL_FLOAT, 1, 0),
+        MAKE(GRAFIKATTRTYPE_VEC2, GL_FLOAT, 2, 0),
+        MAKE(GRAFIKATTRTYPE_VEC3, GL_FLOAT, 3, 0),
+        MAKE(GRAFIKATTRTYPE_VEC4, GL_FLOAT, 4, 0),
 #undef MAKE
-        };
-        ENSURE(0 <= attribKind && attribKind < LENGTH(gfxAttributeLocation));
+};
+
+static const struct {
+        int gl_type;
+        int componentSize;  // in bytes. 0 means all components are packed in 4 bytes
+        int isNormalized;
+        int isInteger;
+} attribformatKind_Info[NUM_ATTRIBFORMAT_KINDS] = {
+        [ATTRIBFORMAT_SNORM16] = { GL_SHORT, 2, 1, 0 },
+        [ATTRIBFORMAT_UNORM8] = { GL_UNSIGNED_BYTE, 1, 1, 0 },
+        [ATTRIBFORMAT_SNORM_2_10_10_10_REV] = { GL_INT_2_10_10_10_REV, 0, 1, 0 },
+        [ATTRIBFORMAT_UINT8] = { GL_UNSIGNED_BYTE, 1, 0, 1 },
+};
+
+static void set_vertex_attrib_pointer(GfxAttributeLocation loc, GfxVAO vao, GfxVBO vbo,
+                                      int num, int gl_type, int isNormalized, int isInteger,
+                                      int stride, int offset)
+{
+        ENSURE(loc >= 0);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(loc);
+        if (isInteger)
+                glVertexAttribIPointer(loc, num, gl_type, stride, (char *) 0 + offset);
+        else
+                glVertexAttribPointer(loc, num, gl_type, isNormalized ? GL_TRUE : GL_FALSE, stride, (char *) 0 + offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+}
+
+void set_attribpointer(int attribKind, GfxVAO vao, GfxVBO vbo, int stride, int offset)
+{
+        ENSURE(0 <= attribKind && attribKind < NUM_ATTRIBUTE_KINDS);
         int gatKind = smAttributeInfo[attribKind].typeKind;
         if (!grafikattrtypeKind_Info[gatKind].isSupported)
                 fatal_f("Can't set attrib pointer. This type is not yet supported!");
         int gl_type = grafikattrtypeKind_Info[gatKind].gl_type;
         int num = grafikattrtypeKind_Info[gatKind].num;
-        GfxAttributeLocation loc = gfxAttributeLocation[attribKind];
+        int isInteger = grafikattrtypeKind_Info[gatKind].isInteger;
+        set_vertex_attrib_pointer(smAttributeInfo[attribKind].location, vao, vbo,
+                                  num, gl_type, 0, isInteger, stride, offset);
+}
 
-        ENSURE(loc >= 0);
+/* Like set_attribpointer(), but the data is stored in one of the
+ATTRIBFORMAT_ formats. size is the size of the struct member that holds the
+data, it may be larger than needed (for alignment padding). */
+void set_packed_attribpointer(int attribKind, int attribformatKind, GfxVAO vao, GfxVBO vbo, int stride, int offset, int size)
+{
+        ENSURE(0 <= attribKind && attribKind < NUM_ATTRIBUTE_KINDS);
+        ENSURE(0 <= attribformatKind && attribformatKind < NUM_ATTRIBFORMAT_KINDS);
+        int gatKind = smAttributeInfo[attribKind].typeKind;
+        if (!grafikattrtypeKind_Info[gatKind].isSupported)
+                fatal_f("Can't set attrib pointer. This type is not yet supported!");
+        if (grafikattrtypeKind_Info[gatKind].isInteger != attribformatKind_Info[attribformatKind].isInteger)
+                fatal_f("Can't set attrib pointer for attribute '%s': format does not match the attribute type",
+                        smAttributeInfo[attribKind].name);
+        int gl_type = attribformatKind_Info[attribformatKind].gl_type;
+        int componentSize = attribformatKind_Info[attribformatKind].componentSize;
+        int isNormalized = attribformatKind_Info[attribformatKind].isNormalized;
+        int isInteger = attribformatKind_Info[attribformatKind].isInteger;
+        int num = grafikattrtypeKind_Info[gatKind].num;
+        if (componentSize == 0) {
+                num = 4;
+                ENSURE(size >= 4);
+        }
+        else
+                ENSURE(size >= num * componentSize);
+        set_vertex_attrib_pointer(smAttributeInfo[attribKind].location, vao, vbo,
+                                  num, gl_type, isNormalized, isInteger, stride, offset);
+}
+
+/* Make all attributes of the given program advance once per instance instead
+of once per vertex. */
+static void set_instanced_attributes(int programIndex, GfxVAO vao)
+{
         glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glEnableVertexAttribArray(loc);
-        glVertexAttribPointer(loc, num, gl_type, GL_FALSE, stride, (char *) 0 + offset);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (int i = 0; i < NUM_ATTRIBUTE_KINDS; i++) {
+                if (smAttributeInfo[i].programIndex != programIndex)
+                        continue;
+                glVertexAttribDivisor(smAttributeInfo[i].location, 1);
+        }
         glBindVertexArray(0);
 }
 
+/* glGetError() may have to wait for the driver, so release builds rely on
+the GL_KHR_debug messages (see gldebug.c). */
+#ifdef NDEBUG
+#define CHECK_GL_ERRORS() ((void) 0)
+#else
 #define CHECK_GL_ERRORS() check_gl_errors(__FILE__, __LINE__)
+#endif
 #define SET_ARRAY_BUFFER_DATA(bufferId, data, numElems) set_array_buffer_data((bufferId), (data), (numElems), sizeof *(data))
-#define SET_VERTEX_ATTRIB_POINTER(vao, vbo, loc, numFloats, type, member) set_vertex_attrib_pointer(vao, vbo, loc, numFloats, sizeof (type), offsetof(type, member))
+#define APPEND_ARRAY_BUFFER_DATA(bufferId, capacity, data, numOld, numElems) \
+        append_array_buffer_data((bufferId), (capacity), (data), (numOld), (numElems), sizeof *(data))
 
 static void make_draw_call(GLuint program, GLuint vao, int primitiveKind, int firstIndex, int count)
 {
-        glUseProgram(program);
-        glBindVertexArray(vao);
+        use_program(program);
+        bind_vertex_array(vao);
         glDrawArrays(primitiveKind, firstIndex, count);
-        glBindVertexArray(0);
-        glUseProgram(0);
+        frameStats.numDrawCalls++;
+        frameStats.numVertices += count;
+        bind_vertex_array(0);
+        use_program(0);
+}
+
+static void make_instanced_draw_call(GLuint program, GLuint vao, int primitiveKind, int count, int numInstances)
+{
+        use_program(program);
+        bind_vertex_array(vao);
+        glDrawArraysInstanced(primitiveKind, 0, count, numInstances);
+        frameStats.numDrawCalls++;
+        frameStats.numVertices += (uint64_t) count * numInstances;
+        bind_vertex_array(0);
+        use_program(0);
+}
+
+void set_uniform_1i(int program, int location, int x)
+{
+        use_program(program);
+        glUniform1i(location, x);
+        use_program(0);
 }
 
 void set_uniform_1f(int program, int location, float x)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniform1f(location, x);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_2f(int program, int location, float x, float y)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniform2f(location, x, y);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_3f(int program, int location, float x, float y, float z)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniform3f(location, x, y, z);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_4f(int program, int location, float x, float y, float z, float w)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniform4f(location, x, y, z, w);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_mat2f(int program, int location, const struct Mat2 *mat)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniformMatrix2fv(location, 1, GL_TRUE, &mat->mat[0][0]);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_mat3f(int program, int location, const struct Mat3 *mat)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniformMatrix3fv(location, 1, GL_TRUE, &mat->mat[0][0]);
-        glUseProgram(0);
+        use_program(0);
 }
 
 void set_uniform_mat4f(int program, int location, const struct Mat4 *mat)
 {
-        glUseProgram(program);
+        use_program(program);
         glUniformMatrix4fv(location, 1, GL_TRUE, &mat->mat[0][0]);
-        glUseProgram(0);
+        use_program(0);
 }
 
+static GLenum polygonMode = GL_FILL;
+static int shapeCacheIsValid;
+
+static void invalidate_shape_tiles(void);
+static void update_shape_tile_samples(void);
+
 static void change_mode(void)
 {
 static int mode;
 mode++;
 if (mode == 3) mode = 0;
 if (mode == 0)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        polygonMode = GL_FILL;
 else if (mode == 1) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        polygonMode = GL_FILL;
 }
 else if (mode == 2)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        polygonMode = GL_LINE;
+glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+shapeCacheIsValid = 0;
+invalidate_shape_tiles();
+windowIsDamaged = 1;
 }
 
-static GLuint lineVBO;
-static GLuint lineVAO;
+static GLuint shapeVBO;
+static GLuint shapeVAO;
+static GLuint previewVBO;
+static GLuint previewVAO;
+
+/* The committed shapes only change when a shape is committed or the view
+changes, so they are drawn into textures that are composited each frame.
+The depth is cached too, such that the preview and the 3D scene are depth
+tested against the shapes as if these were drawn directly. The textures have
+the samples of the framebuffer that the scene is drawn into, so the shapes
+keep their antialiased edges. */
+static int haveShapeCache;
+static GLuint shapeCacheFBO;
+static GLuint shapeCacheColorTexture;
+static GLuint shapeCacheDepthTexture;
+static int shapeCacheWidth;
+static int shapeCacheHeight;
+static int shapeCacheSamples;
+static struct Mat4 shapeCacheTransform;
+static GLuint compositeVAO;  // no attributes, but drawing needs a VAO
+
+/* Large drawings are not redrawn shape by shape when the view changes.
+Instead, the plane of the shapes is divided into square tiles, which are
+rendered at a level of detail that fits the zoom factor. Each level halves
+the size of the tiles in the plane, so it doubles the resolution. The tiles live in a fixed-size atlas
+texture, and the least recently used ones get replaced. A tile that is in
+the atlas already only gets the shapes that were committed since it was
+last drawn. With MSAA, the tiles are drawn into a multisampled tile with the
+samples of the MSAA buffers and resolved into the atlas, and a tile that
+gets new shapes is drawn again. */
+enum {
+        MIN_SHAPES_FOR_TILES = 4096,
+        TILE_SIZE = 256,  // in texels
+        TILE_ATLAS_SIZE = 2048,
+        TILES_PER_ATLAS_ROW = TILE_ATLAS_SIZE / TILE_SIZE,
+        NUM_TILE_SLOTS = TILES_PER_ATLAS_ROW * TILES_PER_ATLAS_ROW,
+        MAX_TILE_LEVEL = 8,
+};
 
-static GLuint circleVBO;
-static GLuint circleVAO;
+struct ShapeTile {
+        int isUsed;
+        int level;
+        int x;  // the tile covers [x, x+1] * size, where size is 1 / 2^level
+        int y;
+        int numShapesDrawn;  // the shapes [0, numShapesDrawn) are in the tile
+        int lastUsedPass;
+};
 
-static GLuint arcVBO;
-static GLuint arcVAO;
+static struct ShapeTile shapeTiles[NUM_TILE_SLOTS];  // slot i is at column i % TILES_PER_ATLAS_ROW
+static int haveShapeTiles;
+static int tilePass;
+static GLuint tileAtlasFBO;
+static GLuint tileAtlasColorTexture;
+static GLuint tileAtlasDepthTexture;
+static int tileSamples;  // of tileMsaaFBO, or 0 to draw into the atlas directly
+static GLuint tileMsaaFBO;
+static GLuint tileMsaaColorTexture;
+static GLuint tileMsaaDepthTexture;
+static GLuint tileResolveFBO;
+static GLuint tileResolveTexture;
+static GLuint tileVBO;
+static GLuint tileVAO;
+static GLuint newShapesVBO;  // the shapes that are missing from a tile
+static GLuint newShapesVAO;
+static struct shapeVertex *tileShapes;
+static int numTileShapes;
+static int *tileShapeIndices;
+static int shapeBinPass;
+static struct tileVertex *tileVertices;
+static int numTileVertices;
 
 static GLuint v3VBO;
 static GLuint v3VAO;
+static int haveUploadWorker;
+static int v3Upload = -1;  // the upload of v3Vertices in flight, or -1
+static int numV3VerticesUploading;
+static int numV3VerticesOnGpu;  // the levels below this can be drawn
+
+/* The programs (not the variants) are started when the window is set up.
+The variants are started when they are first used. */
+enum {
+        MAX_SHADERS_PER_PROGRAM = 4,
+};
+static GLuint programShaders[NUM_PROGRAM_KINDS][MAX_SHADERS_PER_PROGRAM];
+static int programIsReady[NUM_PROGRAM_KINDS];
+static int programIsCached[NUM_PROGRAM_KINDS];
+static uint64_t programStartTime[NUM_PROGRAM_KINDS];
+static int numEagerPrograms;
+static int numEagerProgramsReady;
+static int programsNeedStoring;
+static int programsFromCache;
+static int haveParallelShaderCompile;
+static int haveShaderReload;
+static int haveReloadedShaders;
+static GLuint reloadingProgram[NUM_PROGRAM_KINDS];
+static GLuint reloadingShaders[NUM_PROGRAM_KINDS][MAX_SHADERS_PER_PROGRAM];
+static uint64_t programsStartTime;
+
+static void upload_v3_vertices(void);
+static const struct MeshLevel *get_drawable_mesh_level(int meshKind, int lodLevel);
+static void ensure_program(int programIndex);
+static int poll_program(int programIndex);
+static void poll_started_programs(void);
+static void reload_changed_programs(void);
+static void reallocate_shape_cache(void);
+static int update_shape_cache(void);
+static void composite_shape_cache(void);
+static struct Rect update_damage(const struct shapeVertex *preview, int numPreview, int v3Program);
+static struct Rect get_damage_since(int age);
+static int update_msaa_buffers(void);
+static void change_msaa_samples(void);
+static void update_render_size(void);
+static int update_scaled_buffers(void);
+static int begin_frame_timer(void);
+static void end_frame_timer(int t, int isFullFrame);
+static void toggle_dynamic_resolution(void);
+static struct Rect get_hud_rect(void);
+static void draw_hud(void);
+static void add_hud_frame_times(uint64_t frameStartNs, uint64_t swapStartNs, uint64_t swapEndNs);
+static void add_latency_samples(uint64_t inputNs, uint64_t latchNs, uint64_t swapEndNs);
+static void report_latency(void);
 
 void do_gfx(void)
 {
-        //make_3d_axes();
-        make_torus();
-        //make_sphere();
-
         for (;;) {
+                TRACE_SCOPE("frame");
+                uint64_t frameStartNs = get_time_ns();
                 fetch_all_pending_events();
 
+                uint64_t inputNs = 0;  // of the oldest input event
                 while (have_events()) {
                         struct Event event;
                         dequeue_event(&event);
+                        frameStats.numEvents++;
+                        if (inputNs == 0 && event.eventKind != EVENT_WINDOWRESIZE)
+                                inputNs = event.timeNs;
                         if (event.eventKind == EVENT_KEY) {
                                 if (event.tKey.keyKind == KEY_ESCAPE) {
+                                        if (latencyReportInterval > 0.f)
+                                                report_latency();
+                                        if (haveUploadWorker)
+                                                stop_upload_worker();
                                         close_window();
                                         exit(0);
                                 }
@@ -638,6 +1346,18 @@ void do_gfx(void)
                                 else if (event.tKey.keyKind == KEY_BACKSPACE) {
                                         change_mode();
                                 }
+                                else if (event.tKey.keyKind == KEY_ENTER) {
+                                        sceneIsUnlit = !sceneIsUnlit;
+                                }
+                                else if (event.tKey.keyKind == KEY_F1) {
+                                        hudIsVisible = !hudIsVisible;
+                                }
+                                else if (event.tKey.keyKind == KEY_F2) {
+                                        change_msaa_samples();
+                                }
+                                else if (event.tKey.keyKind == KEY_F3) {
+                                        toggle_dynamic_resolution();
+                                }
                                 else if (event.tKey.keyKind == KEY_LEFT) {
                                         viewingAngleY = add_modulo_2pi(viewingAngleY, 0.2f);
                                 }
@@ -661,8 +1381,7 @@ void do_gfx(void)
                                 }
                         }
                         else if (event.eventKind == EVENT_MOUSEMOVE) {
-                                mouseX = (2.0f * event.tMousemove.x / windowWidth) - 1.0f;
-                                mouseY = - ((2.0f * event.tMousemove.y / windowHeight) - 1.0f);
+                                set_mouse_position(event.tMousemove.x, event.tMousemove.y);
                         }
                         else if (event.eventKind == EVENT_SCROLL) {
                                 zoomFactor += 0.25f * event.tScroll.amount;
@@ -674,201 +1393,1609 @@ void do_gfx(void)
                         else if (event.eventKind == EVENT_WINDOWRESIZE) {
                                 windowWidth = event.tWindowresize.w;
                                 windowHeight = event.tWindowresize.h;
-                                glViewport(0, 0, windowWidth, windowHeight);
+                                windowIsDamaged = 1;
                         }
                 }
 
-                add_line(currentX, currentY, mouseX, mouseY);
-                add_circle(mouseX, mouseY);
-                add_arc((struct Vec2) {arcX, arcY}, (struct Vec2) { currentX, currentY }, (struct Vec2) {mouseX, mouseY});
+                if (shapeInstancesChanged) {
+                        APPEND_ARRAY_BUFFER_DATA(shapeVBO, &shapeVBOCapacity, shapeInstances,
+                                                 numShapeInstancesUploaded, numShapeInstances);
+                        numShapeInstancesUploaded = numShapeInstances;
+                        shapeInstancesChanged = 0;
+                        shapeCacheIsValid = 0;
+                }
+                poll_started_programs();
+                if (haveShaderReload)
+                        reload_changed_programs();
+
+                update_render_size();
+                int isScaled = update_scaled_buffers();
+                compute_screen_transform();
 
-                SET_ARRAY_BUFFER_DATA(lineVBO, lineVertices, numLineVertices);
-                SET_ARRAY_BUFFER_DATA(circleVBO, circleVertices, numCircleVertices);
-                SET_ARRAY_BUFFER_DATA(arcVBO, arcVertices, numArcVertices);
-                SET_ARRAY_BUFFER_DATA(v3VBO, v3Vertices, numV3Vertices);
+                int sceneLodLevels[LENGTH(sceneMeshKinds)];
+                for (int i = 0; i < LENGTH(sceneMeshKinds); i++) {
+                        sceneLodLevels[i] = select_lod_level(sceneMeshKinds[i]);
+                        get_mesh_level(sceneMeshKinds[i], sceneLodLevels[i]);
+                }
+                upload_v3_vertices();
                 CHECK_GL_ERRORS();
 
-                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-                compute_screen_transform();
+                ensure_program(PROGRAM_shape);
+                shapeShader_set_screenTransform(&screenTransform);
 
-                lineShader_set_screenTransform(&screenTransform);
-                circleShader_set_screenTransform(&screenTransform);
-                arcShader_set_screenTransform(&screenTransform);
-                v3Shader_set_screenTransform(&screenTransform);
+                int frameTimer = begin_frame_timer();
 
                 glDisable(GL_CULL_FACE);
-                make_draw_call(gfxProgram[PROGRAM_line], lineVAO, GL_TRIANGLES, 0, numLineVertices);
-                make_draw_call(gfxProgram[PROGRAM_circle], circleVAO, GL_TRIANGLES, 0, numCircleVertices);
-                make_draw_call(gfxProgram[PROGRAM_arc], arcVAO, GL_TRIANGLES, 0, numArcVertices);
-
-                //glEnable(GL_CULL_FACE);
-                make_draw_call(gfxProgram[PROGRAM_v3], v3VAO, GL_TRIANGLES, 0, numV3Vertices);
+                int haveMsaa = update_msaa_buffers();
+                // drawing into the cache must happen outside of the scissor rect
+                int haveCachedShapes = update_shape_cache();
+
+                // the rest of the frame is prepared, now is the latest we can
+                // take the mouse position for the preview
+                uint64_t latchNs = 0;
+                if (haveLateLatch) {
+                        int x, y;
+                        latchNs = get_time_ns();
+                        if (query_mouse_position(&x, &y))
+                                set_mouse_position(x, y);
+                        else
+                                latchNs = 0;
+                }
+                struct shapeVertex previewInstances[] = {
+                        make_line(currentX, currentY, mouseX, mouseY),
+                        make_arc((struct Vec2) {arcX, arcY}, (struct Vec2) { currentX, currentY }, (struct Vec2) {mouseX, mouseY}),
+                };
+                SET_ARRAY_BUFFER_DATA(previewVBO, previewInstances, LENGTH(previewInstances));
                 CHECK_GL_ERRORS();
 
-                numLineVertices -= 6;
-                numCircleVertices -= 6;
-                numArcVertices -= 6;
+                // the 3D scene is left out until its program has finished
+                // compiling. While a variant compiles, the plain program is used.
+                int v3Program = PROGRAM_v3 + (sceneIsUnlit ? VARIANTBIT_v3_UNLIT : 0);
+                if (!poll_program(v3Program))
+                        v3Program = PROGRAM_v3;
+                if (!poll_program(v3Program))
+                        v3Program = -1;
+
+                struct Rect damage = update_damage(previewInstances, LENGTH(previewInstances), v3Program);
+                int backBufferAge = get_back_buffer_age();
+                struct Rect redrawRect;
+                if (haveMsaa || isScaled) {
+                        // the offscreen buffer has everything but the current damage
+                        redrawRect = damage;
+                        glBindFramebuffer(GL_FRAMEBUFFER, haveMsaa ? msaaFBO : scaledFBO);
+                }
+                else
+                        redrawRect = get_damage_since(backBufferAge);
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(redrawRect.x0, redrawRect.y0, redrawRect.x1 - redrawRect.x0, redrawRect.y1 - redrawRect.y0);
+
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                if (haveCachedShapes)
+                        composite_shape_cache();
+                else
+                        make_instanced_draw_call(gfxProgram[PROGRAM_shape], shapeVAO, GL_TRIANGLES, 6, numShapeInstances);
+                make_instanced_draw_call(gfxProgram[PROGRAM_shape], previewVAO, GL_TRIANGLES, 6, LENGTH(previewInstances));
+
+                if (v3Program != -1) {
+                        v3Shader_set_screenTransform(v3Program, &screenTransform);
+                        //glEnable(GL_CULL_FACE);
+                        for (int i = 0; i < LENGTH(sceneMeshKinds); i++) {
+                                const struct MeshLevel *ml = get_drawable_mesh_level(sceneMeshKinds[i], sceneLodLevels[i]);
+                                if (ml != NULL)
+                                        make_draw_call(gfxProgram[v3Program], v3VAO, GL_TRIANGLES, ml->firstVertex, ml->numVertices);
+                        }
+                }
+                glDisable(GL_SCISSOR_TEST);
+                if (haveMsaa) {
+                        // a multisampled buffer can't be resolved and scaled in one go
+                        struct Rect r = isScaled ? damage : get_damage_since(backBufferAge);
+                        glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
+                        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, isScaled ? scaledFBO : 0);
+                        glBlitFramebuffer(r.x0, r.y0, r.x1, r.y1, r.x0, r.y0, r.x1, r.y1,
+                                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                }
+                if (isScaled) {
+                        // the filtering smears the damage, so the whole window is redrawn
+                        glBindFramebuffer(GL_READ_FRAMEBUFFER, scaledFBO);
+                        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, windowWidth, windowHeight,
+                                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+                }
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                end_frame_timer(frameTimer, redrawRect.x1 - redrawRect.x0 == renderWidth
+                                            && redrawRect.y1 - redrawRect.y0 == renderHeight);
+                draw_hud();
+                CHECK_GL_ERRORS();
 
+                end_frame_stats();
+                uint64_t swapStartNs = get_time_ns();
                 swap_buffers();
+                uint64_t swapEndNs = get_time_ns();
+                add_hud_frame_times(frameStartNs, swapStartNs, swapEndNs);
+                if (latencyReportInterval > 0.f)
+                        add_latency_samples(inputNs, latchNs, swapEndNs);
         }
 
-        glDeleteBuffers(1, &lineVBO);
-        glDeleteVertexArrays(1, &lineVAO);
+        glDeleteBuffers(1, &shapeVBO);
+        glDeleteVertexArrays(1, &shapeVAO);
 }
 
-static const struct {
-        void **funcptr;
-        const char *name;
-} procsToLoad[] = {
-#define MAKE(type, name) { (void**)&name, #name },
-#include <segments/openglprocs.h>
-#undef MAKE
-};
-
-static const int shadertypeMap[NUM_SHADERTYPE_KINDS] = {
-        [SHADERTYPE_VERTEX] = GL_VERTEX_SHADER,
-        [SHADERTYPE_FRAGMENT] = GL_FRAGMENT_SHADER,
-};
+static void invalidate_shape_tiles(void)
+{
+        for (int i = 0; i < NUM_TILE_SLOTS; i++)
+                shapeTiles[i].isUsed = 0;
+}
 
-static int get_compile_status(int shaderIndex)
+/* Choose the level at which the tiles have at least as many texels as the
+shapes cover pixels on the screen, and the range of tiles that is visible
+at that level. Returns 0 if the visible tiles don't fit in the atlas. */
+static int select_shape_tiles(int *outLevel, int *outX0, int *outY0, int *outX1, int *outY1)
 {
-	GLint shader = gfxShader[shaderIndex];
-	const char *name = smShaderInfo[shaderIndex].name;
-        GLint compileStatus;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
-        if (compileStatus != GL_TRUE) {
-                GLchar errorBuf[1024];
-                GLsizei length;
-                glGetShaderInfoLog(shader, sizeof errorBuf, &length, errorBuf);
-                message_f("Warning: shader '%s' failed to compile: %s\n",
-			  name, errorBuf);
+        // the shapes are in the z=0 plane, so the transform is a linear 2D map
+        float a = screenTransform.mat[0][0];
+        float b = screenTransform.mat[0][1];
+        float c = screenTransform.mat[1][0];
+        float d = screenTransform.mat[1][1];
+        float det = a * d - b * c;
+        struct Vec2 viewMin = shapesMin;
+        struct Vec2 viewMax = shapesMax;
+        if (fabsf(det) > 1e-6f) {
+                // bounding box of the screen corners mapped back to the plane
+                float hw = (fabsf(d) + fabsf(b)) / fabsf(det);
+                float hh = (fabsf(c) + fabsf(a)) / fabsf(det);
+                viewMin.x = fmaxf(viewMin.x, -hw);
+                viewMin.y = fmaxf(viewMin.y, -hh);
+                viewMax.x = fminf(viewMax.x, hw);
+                viewMax.y = fminf(viewMax.y, hh);
         }
-        return compileStatus == GL_TRUE;
+        if (viewMin.x > viewMax.x || viewMin.y > viewMax.y)
+                return 0;
+        float pixelsPerUnit = 0.5f * (renderWidth > renderHeight ? renderWidth : renderHeight) * zoomFactor;
+        int level = (int) ceilf(log2f(pixelsPerUnit / TILE_SIZE));
+        level = (int) clamp((float) level, 0.f, (float) MAX_TILE_LEVEL);
+        // use coarser tiles if the finer ones don't fit
+        for (; level >= 0; level--) {
+                float tilesPerUnit = (float) (1 << level);
+                int x0 = (int) floorf(viewMin.x * tilesPerUnit);
+                int y0 = (int) floorf(viewMin.y * tilesPerUnit);
+                int x1 = (int) floorf(viewMax.x * tilesPerUnit);
+                int y1 = (int) floorf(viewMax.y * tilesPerUnit);
+                if ((x1 - x0 + 1) * (y1 - y0 + 1) <= NUM_TILE_SLOTS) {
+                        *outLevel = level;
+                        *outX0 = x0;
+                        *outY0 = y0;
+                        *outX1 = x1;
+                        *outY1 = y1;
+                        return 1;
+                }
+        }
+        return 0;
 }
 
-static int get_link_status(int programIndex)
+/* Return the slot of the given tile, reusing the least recently used slot
+if the tile isn't in the atlas. Slots that are used in the current pass are
+never reused. */
+static int get_shape_tile_slot(int level, int x, int y)
 {
-	GLint program = gfxProgram[programIndex];
-	const char *name = smProgramInfo[programIndex].name;
-        GLint linkStatus;
-        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus != GL_TRUE) {
-                GLsizei length;
-                GLchar errorBuf[128];
-                glGetProgramInfoLog(program, sizeof errorBuf,
-                        &length, errorBuf);
-                message_f("Warning: Failed to link shader program '%s': %s\n",
-			  name, errorBuf);
+        int slot = -1;
+        for (int i = 0; i < NUM_TILE_SLOTS; i++) {
+                struct ShapeTile *tile = &shapeTiles[i];
+                if (tile->isUsed && tile->level == level && tile->x == x && tile->y == y) {
+                        tile->lastUsedPass = tilePass;
+                        return i;
+                }
+                if (slot == -1 || !tile->isUsed
+                    || (shapeTiles[slot].isUsed && tile->lastUsedPass < shapeTiles[slot].lastUsedPass))
+                        slot = i;
         }
-        return linkStatus == GL_TRUE;
+        ENSURE(!shapeTiles[slot].isUsed || shapeTiles[slot].lastUsedPass != tilePass);
+        shapeTiles[slot] = (struct ShapeTile) {
+                .isUsed = 1, .level = level, .x = x, .y = y, .lastUsedPass = tilePass,
+        };
+        return slot;
 }
 
-void setup_opengl(void)
+static int compare_ints(const void *a, const void *b)
 {
+        int x = *(const int *) a;
+        int y = *(const int *) b;
+        return (x > y) - (x < y);
+}
+
+static void gather_shape_if_overlapping(int idx, struct Vec2 tileMin, struct Vec2 tileMax)
+{
+        struct Vec2 min, max;
+        get_shape_bounds(&shapeInstances[idx], &min, &max);
+        if (max.x < tileMin.x || min.x > tileMax.x || max.y < tileMin.y || min.y > tileMax.y)
+                return;
+        REALLOC_MEMORY(&tileShapes, numTileShapes + 1);
+        tileShapes[numTileShapes++] = shapeInstances[idx];
+}
+
+/* Fill tileShapes with the shapes that the tile is missing and that overlap
+it, in the order in which they were committed. */
+static void gather_tile_shapes(const struct ShapeTile *tile)
+{
+        float size = 1.f / (float) (1 << tile->level);
+        struct Vec2 tileMin = { tile->x * size, tile->y * size };
+        struct Vec2 tileMax = { tileMin.x + size, tileMin.y + size };
+        numTileShapes = 0;
+        if (tile->numShapesDrawn > 0) {
+                // usually just the last committed shape
+                for (int i = tile->numShapesDrawn; i < numShapeInstances; i++)
+                        gather_shape_if_overlapping(i, tileMin, tileMax);
+                return;
+        }
+        int numIndices = 0;
+        shapeBinPass++;
+        int x0, y0, x1, y1;
+        get_shape_bin_range(tileMin, tileMax, &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                        struct ShapeBin *bin = &shapeBins[get_shape_bin(x, y)];
+                        if (bin->lastGatheredPass == shapeBinPass)
+                                continue;
+                        bin->lastGatheredPass = shapeBinPass;
+                        REALLOC_MEMORY(&tileShapeIndices, numIndices + bin->numShapes);
+                        COPY_MEMORY(tileShapeIndices + numIndices, bin->shapes, bin->numShapes);
+                        numIndices += bin->numShapes;
+                }
+        }
+        REALLOC_MEMORY(&tileShapeIndices, numIndices + numLargeShapes);
+        COPY_MEMORY(tileShapeIndices + numIndices, largeShapes, numLargeShapes);
+        numIndices += numLargeShapes;
+        // a shape is in every bin that it overlaps, and the order matters
+        qsort(tileShapeIndices, numIndices, sizeof *tileShapeIndices, compare_ints);
+        for (int i = 0; i < numIndices; i++)
+                if (i == 0 || tileShapeIndices[i] != tileShapeIndices[i - 1])
+                        gather_shape_if_overlapping(tileShapeIndices[i], tileMin, tileMax);
+}
+
+/* Draw the shapes that the tile is missing into its slot in the atlas. The
+shapes are drawn with the depth test: they all have the same depth, so each
+texel gets written at most once, like when drawing them directly. The color
+gets premultiplied by the blend function, see update_shape_tiles(). */
+static void update_shape_tile(int slot)
+{
+        struct ShapeTile *tile = &shapeTiles[slot];
+        if (tile->numShapesDrawn == numShapeInstances)
+                return;
+        gather_tile_shapes(tile);
+        if (tile->numShapesDrawn > 0 && numTileShapes == 0) {
+                // none of the new shapes are in this tile
+                tile->numShapesDrawn = numShapeInstances;
+                return;
+        }
+        if (tile->numShapesDrawn > 0 && tileSamples > 0) {
+                // the samples are gone after the resolve, so all of them
+                tile->numShapesDrawn = 0;
+                gather_tile_shapes(tile);
+        }
+        float size = 1.f / (float) (1 << tile->level);
+        float x0 = tile->x * size;
+        float y0 = tile->y * size;
+        struct Mat4 tileTransform = {{
+                { 2.f / size, 0.f, 0.f, -2.f * x0 / size - 1.f },
+                { 0.f, 2.f / size, 0.f, -2.f * y0 / size - 1.f },
+                { 0.f, 0.f, 1.f, 0.f },
+                { 0.f, 0.f, 0.f, 1.f },
+        }};
+        int sx = (slot % TILES_PER_ATLAS_ROW) * TILE_SIZE;
+        int sy = (slot / TILES_PER_ATLAS_ROW) * TILE_SIZE;
+        int vx = tileSamples > 0 ? 0 : sx;
+        int vy = tileSamples > 0 ? 0 : sy;
+        glBindFramebuffer(GL_FRAMEBUFFER, tileSamples > 0 ? tileMsaaFBO : tileAtlasFBO);
+        glViewport(vx, vy, TILE_SIZE, TILE_SIZE);
+        if (tile->numShapesDrawn == 0) {
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(vx, vy, TILE_SIZE, TILE_SIZE);
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glDisable(GL_SCISSOR_TEST);
+        }
+        shapeShader_set_screenTransform(&tileTransform);
+        if (numTileShapes == numShapeInstances)
+                // all of them, which are on the GPU already
+                make_instanced_draw_call(gfxProgram[PROGRAM_shape], shapeVAO, GL_TRIANGLES, 6, numShapeInstances);
+        else if (numTileShapes > 0) {
+                SET_ARRAY_BUFFER_DATA(newShapesVBO, tileShapes, numTileShapes);
+                make_instanced_draw_call(gfxProgram[PROGRAM_shape], newShapesVAO, GL_TRIANGLES, 6, numTileShapes);
+        }
+        if (tileSamples > 0) {
+                // a resolve can't move the pixels, so it goes through a texture of the size of a tile
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, tileMsaaFBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, tileResolveFBO);
+                glBlitFramebuffer(0, 0, TILE_SIZE, TILE_SIZE, 0, 0, TILE_SIZE, TILE_SIZE,
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, tileResolveFBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, tileAtlasFBO);
+                glBlitFramebuffer(0, 0, TILE_SIZE, TILE_SIZE, sx, sy, sx + TILE_SIZE, sy + TILE_SIZE,
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        tile->numShapesDrawn = numShapeInstances;
+}
+
+/* Bring the visible tiles up to date and fill tileVertices with a quad for
+each of them. Returns 0 if the tiles can't be used for the current view. */
+static int update_shape_tiles(void)
+{
+        TRACE_SCOPE("update_shape_tiles");
+        int level, x0, y0, x1, y1;
+        if (!select_shape_tiles(&level, &x0, &y0, &x1, &y1))
+                return 0;
+        tilePass++;
+        numTileVertices = 0;
+        // store premultiplied color, so that filtering doesn't pull in the
+        // black of the empty texels
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ZERO, GL_ONE, GL_ZERO);
+        for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                        int slot = get_shape_tile_slot(level, x, y);
+                        update_shape_tile(slot);
+                        float size = 1.f / (float) (1 << level);
+                        // half a texel inwards, so the neighbours in the atlas don't bleed in
+                        float u0 = ((slot % TILES_PER_ATLAS_ROW) * TILE_SIZE + 0.5f) / TILE_ATLAS_SIZE;
+                        float v0 = ((slot / TILES_PER_ATLAS_ROW) * TILE_SIZE + 0.5f) / TILE_ATLAS_SIZE;
+                        float u1 = u0 + (TILE_SIZE - 1.f) / TILE_ATLAS_SIZE;
+                        float v1 = v0 + (TILE_SIZE - 1.f) / TILE_ATLAS_SIZE;
+                        struct tileVertex corners[4] = {
+                                { { x * size, y * size }, { u0, v0 } },
+                                { { (x + 1) * size, y * size }, { u1, v0 } },
+                                { { (x + 1) * size, (y + 1) * size }, { u1, v1 } },
+                                { { x * size, (y + 1) * size }, { u0, v1 } },
+                        };
+                        static const int quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+                        REALLOC_MEMORY(&tileVertices, numTileVertices + 6);
+                        for (int i = 0; i < 6; i++)
+                                tileVertices[numTileVertices++] = corners[quadIndices[i]];
+                }
+        }
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, renderWidth, renderHeight);
+        shapeShader_set_screenTransform(&screenTransform);
+        SET_ARRAY_BUFFER_DATA(tileVBO, tileVertices, numTileVertices);
         CHECK_GL_ERRORS();
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
+        return 1;
+}
+
+static void draw_shape_tiles(void)
+{
+        ensure_program(PROGRAM_tile);
+        tileShader_set_screenTransform(&screenTransform);
+        tileShader_set_atlasTexture(0);
+        glBindTexture(GL_TEXTURE_2D, tileAtlasColorTexture);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        make_draw_call(gfxProgram[PROGRAM_tile], tileVAO, GL_TRIANGLES, 0, numTileVertices);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        //glDisable(GL_MULTISAMPLE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-                        CHECK_GL_ERRORS();
-        for (int i = 0; i < sizeof procsToLoad / sizeof procsToLoad[0]; i++) {
-                const char *name = procsToLoad[i].name;
-                *procsToLoad[i].funcptr = load_opengl_pointer(name);
+static int rect_is_empty(struct Rect r)
+{
+        return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+static struct Rect rect_union(struct Rect a, struct Rect b)
+{
+        if (rect_is_empty(a))
+                return b;
+        if (rect_is_empty(b))
+                return a;
+        return (struct Rect) {
+                a.x0 < b.x0 ? a.x0 : b.x0,
+                a.y0 < b.y0 ? a.y0 : b.y0,
+                a.x1 > b.x1 ? a.x1 : b.x1,
+                a.y1 > b.y1 ? a.y1 : b.y1,
+        };
+}
+
+/* The pixels that the shapes might cover, using the current screen
+transform. */
+static struct Rect get_shapes_screen_rect(const struct shapeVertex *shapes, int numShapes)
+{
+        if (numShapes == 0)
+                return (struct Rect) { 0, 0, 0, 0 };
+        const float (*m)[4] = screenTransform.mat;
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        for (int i = 0; i < numShapes; i++) {
+                struct Vec2 min, max;
+                get_shape_bounds(&shapes[i], &min, &max);
+                for (int j = 0; j < 4; j++) {
+                        float x = j & 1 ? max.x : min.x;
+                        float y = j & 2 ? max.y : min.y;
+                        float nx = m[0][0] * x + m[0][1] * y + m[0][3];
+                        float ny = m[1][0] * x + m[1][1] * y + m[1][3];
+                        minX = fminf(minX, nx);
+                        minY = fminf(minY, ny);
+                        maxX = fmaxf(maxX, nx);
+                        maxY = fmaxf(maxY, ny);
+                }
         }
-                CHECK_GL_ERRORS();
-        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
-                int kind = shadertypeMap[smShaderInfo[i].shadertypeKind];
-                gfxShader[i] = glCreateShader(kind);
+        // a few pixels of margin for rasterization
+        float x0 = floorf((minX + 1.f) * 0.5f * renderWidth) - 2.f;
+        float y0 = floorf((minY + 1.f) * 0.5f * renderHeight) - 2.f;
+        float x1 = ceilf((maxX + 1.f) * 0.5f * renderWidth) + 2.f;
+        float y1 = ceilf((maxY + 1.f) * 0.5f * renderHeight) + 2.f;
+        return (struct Rect) {
+                (int) clamp(x0, 0.f, (float) renderWidth),
+                (int) clamp(y0, 0.f, (float) renderHeight),
+                (int) clamp(x1, 0.f, (float) renderWidth),
+                (int) clamp(y1, 0.f, (float) renderHeight),
+        };
+}
+
+/* Sends the new mesh levels to the GPU. With the upload worker only the
+vertices that aren't on the GPU yet are sent, into a new buffer that replaces
+v3VBO when it is ready. Until then the new levels can't be drawn. */
+static void upload_v3_vertices(void)
+{
+        if (v3Upload != -1) {
+                GLuint buffer;
+                if (!poll_upload(v3Upload, &buffer))
+                        return;
+                v3Upload = -1;
+                if (buffer == 0) {
+                        LOG_WARNING(LOGCATEGORY_GFX, "Uploading the meshes on the main thread from now on");
+                        haveUploadWorker = 0;
+                        v3VerticesChanged = 1;
+                }
+                else {
+                        glDeleteBuffers(1, &v3VBO);
+                        v3VBO = buffer;
+                        setup_v3_vao(v3VAO, v3VBO);
+                        numV3VerticesOnGpu = numV3VerticesUploading;
+                        windowIsDamaged = 1;
+                }
+        }
+        if (!v3VerticesChanged)
+                return;
+        if (haveUploadWorker && has_upload_worker_failed()) {
+                LOG_WARNING(LOGCATEGORY_GFX, "The upload worker failed, uploading the meshes on the main thread");
+                haveUploadWorker = 0;
+        }
+        if (!haveUploadWorker) {
+                SET_ARRAY_BUFFER_DATA(v3VBO, v3Vertices, numV3Vertices);
+                numV3VerticesOnGpu = numV3Vertices;
+                v3VerticesChanged = 0;
+                return;
+        }
+        int numNew = numV3Vertices - numV3VerticesOnGpu;
+        struct v3Vertex *newVertices;
+        ALLOC_MEMORY(&newVertices, numNew);
+        COPY_MEMORY(newVertices, v3Vertices + numV3VerticesOnGpu, numNew);
+        v3Upload = start_upload(v3VBO, numV3VerticesOnGpu * sizeof *v3Vertices,
+                                newVertices, numNew * sizeof *newVertices);
+        if (v3Upload == -1)
+                return;  // the queue is full or the worker just failed, try again next frame
+        numV3VerticesUploading = numV3Vertices;
+        v3VerticesChanged = 0;
+        frameStats.numBytesUploaded += numNew * sizeof *newVertices;
+}
+
+/* Returns the given level if it is on the GPU, or else the nearest level
+that is (finer ones first), or NULL if there is none. */
+static const struct MeshLevel *get_drawable_mesh_level(int meshKind, int lodLevel)
+{
+        for (int distance = 0; distance < NUM_LOD_LEVELS; distance++) {
+                int candidates[2] = { lodLevel - distance, lodLevel + distance };
+                for (int i = 0; i < 2; i++) {
+                        if (candidates[i] < 0 || candidates[i] >= NUM_LOD_LEVELS)
+                                continue;
+                        const struct MeshLevel *ml = &meshLevels[meshKind][candidates[i]];
+                        if (ml->isGenerated && ml->firstVertex + ml->numVertices <= numV3VerticesOnGpu)
+                                return ml;
+                }
         }
-        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
-		const char *source = smShaderInfo[i].shaderSource;
-                int sourceSize = smShaderInfo[i].shaderSourceSize;
-		glShaderSource(gfxShader[i], 1, &source, &sourceSize);
+        return NULL;
+}
+
+/* Compute and return what changed since the last frame. */
+static struct Rect update_damage(const struct shapeVertex *preview, int numPreview, int v3Program)
+{
+        struct Rect window = { 0, 0, renderWidth, renderHeight };
+        struct Rect previewRect = get_shapes_screen_rect(preview, numPreview);
+        if (memcmp(&lastScreenTransform, &screenTransform, sizeof screenTransform)
+            || v3Program != lastV3Program) {
+                lastScreenTransform = screenTransform;
+                lastV3Program = v3Program;
+                windowIsDamaged = 1;
         }
-        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
-                glCompileShader(gfxShader[i]);
+        struct Rect damage;
+        if (windowIsDamaged)
+                damage = window;
+        else {
+                damage = rect_union(lastPreviewRect, previewRect);
+                damage = rect_union(damage, get_shapes_screen_rect(shapeInstances + numShapesInLastFrame,
+                                                                   numShapeInstances - numShapesInLastFrame));
         }
-        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
-		if (!get_compile_status(i))
-                        fatal_f("Failed to compile!");
+        if (hudIsVisible || hudWasVisible)
+                damage = rect_union(damage, get_hud_rect());
+        hudWasVisible = hudIsVisible;
+        windowIsDamaged = 0;
+        lastPreviewRect = previewRect;
+        numShapesInLastFrame = numShapeInstances;
+        for (int i = MAX_DAMAGE_AGE - 1; i > 0; i--)
+                damageHistory[i] = damageHistory[i - 1];
+        damageHistory[0] = damage;
+        return damage;
+}
+
+/* Return what needs to be redrawn in a buffer that has the contents of age
+frames ago, 0 meaning unknown contents. */
+static struct Rect get_damage_since(int age)
+{
+        if (age == 0 || age > MAX_DAMAGE_AGE)
+                return (struct Rect) { 0, 0, renderWidth, renderHeight };
+        struct Rect r = damageHistory[0];
+        for (int i = 1; i < age; i++)
+                r = rect_union(r, damageHistory[i]);
+        return r;
+}
+
+/* Allocate the multisampled buffers for the render size and msaaSamples.
+Turns MSAA off if the framebuffer is incomplete. */
+static void allocate_msaa_buffers(void)
+{
+        if (msaaSamples == 0 || renderWidth <= 0 || renderHeight <= 0)
+                return;
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaaColorTexture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msaaSamples, GL_RGBA8,
+                                renderWidth, renderHeight, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaaDepthTexture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msaaSamples, GL_DEPTH_COMPONENT24,
+                                renderWidth, renderHeight, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        // the textures only become multisample textures when they are first allocated
+        glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, msaaColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, msaaDepthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CHECK_GL_ERRORS();
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+                LOG_WARNING(LOGCATEGORY_GFX, "MSAA framebuffer with %d samples is incomplete (0x%x), MSAA is off",
+                                             msaaSamples, status);
+                msaaSamples = msaaBufferSamples = 0;
         }
-                CHECK_GL_ERRORS();
-        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
-                gfxProgram[i] = glCreateProgram();
-                if (gfxProgram[i] == 0) {
-                        fatal_f("glCreateProgram() failed");
+}
+
+/* Reallocate the MSAA buffers if the render size or the number of samples
+changed, and with them the shape cache and the tiles, which follow
+msaaBufferSamples. Returns whether the scene is drawn into the MSAA
+buffers. */
+static int update_msaa_buffers(void)
+{
+        if (msaaSamples == msaaBufferSamples
+            && renderWidth == msaaBufferWidth && renderHeight == msaaBufferHeight)
+                return msaaBufferSamples > 0;
+        int oldSamples = msaaBufferSamples;
+        msaaBufferSamples = msaaSamples;
+        msaaBufferWidth = renderWidth;
+        msaaBufferHeight = renderHeight;
+        // the new buffers have no contents yet
+        windowIsDamaged = 1;
+        allocate_msaa_buffers();
+        reallocate_shape_cache();
+        if (msaaBufferSamples != oldSamples)
+                update_shape_tile_samples();
+        return msaaBufferSamples > 0;
+}
+
+static void change_msaa_samples(void)
+{
+        int i = 0;
+        while (i < LENGTH(msaaSampleChoices) && msaaSampleChoices[i] <= msaaSamples)
+                i++;
+        if (i == LENGTH(msaaSampleChoices) || msaaSampleChoices[i] > maxMsaaSamples)
+                i = 0;
+        msaaSamples = msaaSampleChoices[i];
+        LOG_INFO(LOGCATEGORY_GFX, "MSAA: %d samples", msaaSamples);
+}
+
+static void setup_msaa(void)
+{
+        GLint maxColorSamples = 0;
+        GLint maxDepthSamples = 0;
+        glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxColorSamples);
+        glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &maxDepthSamples);
+        maxMsaaSamples = maxColorSamples < maxDepthSamples ? maxColorSamples : maxDepthSamples;
+        const char *env = getenv("SEGMENTS_MSAA_SAMPLES");
+        if (env != NULL)
+                msaaSamples = atoi(env);
+        if (msaaSamples < 0)
+                msaaSamples = 0;
+        if (msaaSamples > maxMsaaSamples)
+                msaaSamples = maxMsaaSamples;
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        msaaColorTexture = textures[0];
+        msaaDepthTexture = textures[1];
+        glGenFramebuffers(1, &msaaFBO);
+        CHECK_GL_ERRORS();
+}
+
+/* Compute the size that the scene is drawn at this frame. */
+static void update_render_size(void)
+{
+        float scale = renderScaleSteps[renderScaleStep];
+        int w = (int) (windowWidth * scale + 0.5f);
+        int h = (int) (windowHeight * scale + 0.5f);
+        if (w != renderWidth || h != renderHeight) {
+                renderWidth = w;
+                renderHeight = h;
+                windowIsDamaged = 1;
+        }
+        glViewport(0, 0, renderWidth, renderHeight);
+}
+
+/* (Re)allocate the buffers that the scene is drawn (or resolved) into before
+it is upscaled. Returns whether the scene is drawn at a reduced size. */
+static int update_scaled_buffers(void)
+{
+        if (renderWidth == windowWidth && renderHeight == windowHeight)
+                return 0;
+        if (renderWidth <= 0 || renderHeight <= 0)
+                return 0;
+        if (renderWidth == scaledBufferWidth && renderHeight == scaledBufferHeight)
+                return 1;
+        glBindTexture(GL_TEXTURE_2D, scaledColorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, renderWidth, renderHeight, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, scaledDepthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, renderWidth, renderHeight, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, scaledFBO);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+                LOG_WARNING(LOGCATEGORY_GFX, "Scaled framebuffer is incomplete (0x%x), no dynamic resolution", status);
+                haveDynamicResolution = 0;
+                renderScaleStep = 0;
+                update_render_size();
+                return 0;
+        }
+        scaledBufferWidth = renderWidth;
+        scaledBufferHeight = renderHeight;
+        windowIsDamaged = 1;
+        return 1;
+}
+
+/* Take the measured GPU time of a full frame into account, and step the
+render scale down if we are over the budget, or up if the next larger scale
+is expected to fit in it. The cost is assumed to grow with the number of
+pixels. The thresholds leave some room, so the scale doesn't flip back and
+forth. */
+static void add_frame_time(float ms)
+{
+        // a single slow frame (say, one that waited for the shader compiler)
+        // shouldn't dominate the average
+        if (ms > 2.f * frameBudgetMs)
+                ms = 2.f * frameBudgetMs;
+        if (numFrameTimesAtScale == 0)
+                gpuFrameMs = ms;
+        else
+                gpuFrameMs = 0.9f * gpuFrameMs + 0.1f * ms;
+        numFrameTimesAtScale++;
+        if (!haveDynamicResolution || numFrameTimesAtScale < MIN_FRAME_TIMES_AT_SCALE)
+                return;
+        int step = renderScaleStep;
+        if (gpuFrameMs > 0.9f * frameBudgetMs && step + 1 < LENGTH(renderScaleSteps))
+                step++;
+        else if (step > 0) {
+                float ratio = renderScaleSteps[step - 1] / renderScaleSteps[step];
+                if (gpuFrameMs * ratio * ratio < 0.75f * frameBudgetMs)
+                        step--;
+        }
+        if (step != renderScaleStep) {
+                LOG_INFO(LOGCATEGORY_GFX, "Render scale: %d%% (GPU frame time %.2f ms)",
+                                          (int) (renderScaleSteps[step] * 100.f + 0.5f), gpuFrameMs);
+                renderScaleStep = step;
+                numFrameTimesAtScale = 0;
+        }
+}
+
+/* Read the results of the timer queries that are done. They finish in the
+order they were started. */
+static void collect_frame_times(void)
+{
+        for (int i = 0; i < NUM_FRAME_TIMERS; i++) {
+                int t = (nextFrameTimer + i) % NUM_FRAME_TIMERS;
+                if (!frameTimerIsPending[t])
+                        continue;
+                GLint isAvailable = GL_FALSE;
+                glGetQueryObjectiv(frameTimerQuery[t], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+                if (!isAvailable)
+                        break;
+                GLuint64 ns;
+                glGetQueryObjectui64v(frameTimerQuery[t], GL_QUERY_RESULT, &ns);
+                frameTimerIsPending[t] = 0;
+                hudGpuMs[hudGpuPos] = ns / 1e6f;
+                hudGpuPos = (hudGpuPos + 1) % HUD_GRAPH_LENGTH;
+                if (frameTimerIsFullFrame[t])
+                        add_frame_time(ns / 1e6f);
+        }
+}
+
+/* Returns the timer that was started, or -1 if all of them are still
+waiting for the GPU. */
+static int begin_frame_timer(void)
+{
+        if (frameTimerQuery[0] == 0)
+                return -1;
+        collect_frame_times();
+        int t = nextFrameTimer;
+        if (frameTimerIsPending[t])
+                return -1;
+        glBeginQuery(GL_TIME_ELAPSED, frameTimerQuery[t]);
+        nextFrameTimer = (t + 1) % NUM_FRAME_TIMERS;
+        return t;
+}
+
+static void end_frame_timer(int t, int isFullFrame)
+{
+        if (t == -1)
+                return;
+        glEndQuery(GL_TIME_ELAPSED);
+        frameTimerIsPending[t] = 1;
+        frameTimerIsFullFrame[t] = isFullFrame;
+}
+
+static void toggle_dynamic_resolution(void)
+{
+        if (frameTimerQuery[0] == 0) {
+                LOG_INFO(LOGCATEGORY_GFX, "Dynamic resolution is not available");
+                return;
+        }
+        haveDynamicResolution = !haveDynamicResolution;
+        if (!haveDynamicResolution)
+                renderScaleStep = 0;
+        numFrameTimesAtScale = 0;
+        LOG_INFO(LOGCATEGORY_GFX, "Dynamic resolution: %s", haveDynamicResolution ? "on" : "off");
+}
+
+static void setup_dynamic_resolution(void)
+{
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        scaledColorTexture = textures[0];
+        scaledDepthTexture = textures[1];
+        for (int i = 0; i < 2; i++) {
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &scaledFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, scaledFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scaledColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scaledDepthTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CHECK_GL_ERRORS();
+        const char *env = getenv("SEGMENTS_FRAME_BUDGET_MS");
+        if (env != NULL && atof(env) > 0)
+                frameBudgetMs = (float) atof(env);
+        // core in OpenGL 3.3
+        if (!have_gl_extension("GL_ARB_timer_query")) {
+                LOG_WARNING(LOGCATEGORY_GL, "GL_ARB_timer_query is not supported, no dynamic resolution");
+                return;
+        }
+        glGenQueries(NUM_FRAME_TIMERS, frameTimerQuery);
+        haveDynamicResolution = 1;
+        CHECK_GL_ERRORS();
+}
+
+/* The part of the scene that the HUD covers, in render pixels from the
+bottom left like the damage. */
+static struct Rect get_hud_rect(void)
+{
+        if (windowWidth <= 0 || windowHeight <= 0)
+                return (struct Rect) { 0, 0, 0, 0 };
+        float sx = (float) renderWidth / windowWidth;
+        float sy = (float) renderHeight / windowHeight;
+        return (struct Rect) {
+                0,
+                (int) clamp(floorf((windowHeight - HUD_HEIGHT) * sy), 0.f, (float) renderHeight),
+                (int) clamp(ceilf(HUD_WIDTH * sx), 0.f, (float) renderWidth),
+                renderHeight,
+        };
+}
+
+static void add_hud_frame_times(uint64_t frameStartNs, uint64_t swapStartNs, uint64_t swapEndNs)
+{
+        hudCpuMs = (float) ns_to_ms(swapStartNs - frameStartNs);
+        hudSwapMs = (float) ns_to_ms(swapEndNs - swapStartNs);
+        if (hudLastFrameStartNs != 0) {
+                hudFrameMs[hudFramePos] = (float) ns_to_ms(frameStartNs - hudLastFrameStartNs);
+                hudFramePos = (hudFramePos + 1) % HUD_GRAPH_LENGTH;
+        }
+        hudLastFrameStartNs = frameStartNs;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+        float x = *(const float *) a;
+        float y = *(const float *) b;
+        return (x > y) - (x < y);
+}
+
+static void log_latency_percentiles(const char *what, float *samples, int numSamples)
+{
+        if (numSamples > MAX_LATENCY_SAMPLES)
+                numSamples = MAX_LATENCY_SAMPLES;
+        if (numSamples == 0)
+                return;
+        qsort(samples, numSamples, sizeof *samples, compare_floats);
+        LOG_INFO(LOGCATEGORY_GFX, "%s to swap latency (%d frames): p50 %.2f p90 %.2f p99 %.2f max %.2f ms",
+                 what, numSamples,
+                 samples[(numSamples - 1) * 50 / 100],
+                 samples[(numSamples - 1) * 90 / 100],
+                 samples[(numSamples - 1) * 99 / 100],
+                 samples[numSamples - 1]);
+}
+
+static void report_latency(void)
+{
+        log_latency_percentiles("Input", eventLatencyMs, numEventLatencies);
+        log_latency_percentiles("Latched mouse", latchLatencyMs, numLatchLatencies);
+        numEventLatencies = 0;
+        numLatchLatencies = 0;
+}
+
+static void add_latency_samples(uint64_t inputNs, uint64_t latchNs, uint64_t swapEndNs)
+{
+        if (inputNs != 0)
+                eventLatencyMs[numEventLatencies++ % MAX_LATENCY_SAMPLES] = (float) ns_to_ms(swapEndNs - inputNs);
+        if (latchNs != 0)
+                latchLatencyMs[numLatchLatencies++ % MAX_LATENCY_SAMPLES] = (float) ns_to_ms(swapEndNs - latchNs);
+        if (lastLatencyReportNs == 0)
+                lastLatencyReportNs = swapEndNs;
+        else if (ns_to_ms(swapEndNs - lastLatencyReportNs) >= 1000.0 * latencyReportInterval) {
+                report_latency();
+                lastLatencyReportNs = swapEndNs;
+        }
+}
+
+static void setup_latency(void)
+{
+        const char *env = getenv("SEGMENTS_LATE_LATCH");
+        haveLateLatch = env == NULL || atoi(env) != 0;
+        env = getenv("SEGMENTS_LATENCY_REPORT");
+        if (env != NULL && atof(env) > 0)
+                latencyReportInterval = (float) atof(env);
+}
+
+static void push_hud_quad(float x0, float y0, float x1, float y1,
+                          float u0, float v0, float u1, float v1, struct Unorm8Vec4 color)
+{
+        int idx = numHudVertices;
+        numHudVertices += 6;
+        REALLOC_MEMORY(&hudVertices, numHudVertices);
+        struct textVertex *v = &hudVertices[idx];
+        v[0] = (struct textVertex) { { x0, y0 }, { u0, v0 }, color };
+        v[1] = (struct textVertex) { { x1, y0 }, { u1, v0 }, color };
+        v[2] = (struct textVertex) { { x1, y1 }, { u1, v1 }, color };
+        v[3] = v[0];
+        v[4] = v[2];
+        v[5] = (struct textVertex) { { x0, y1 }, { u0, v1 }, color };
+}
+
+static void push_hud_rect(float x0, float y0, float x1, float y1, struct Unorm8Vec4 color)
+{
+        // the center of the solid cell
+        float u = ((HUD_SOLID_CELL % HUD_ATLAS_COLUMNS) + 0.5f) * HUD_CELL_WIDTH / HUD_ATLAS_WIDTH;
+        float v = ((HUD_SOLID_CELL / HUD_ATLAS_COLUMNS) + 0.5f) * HUD_CELL_HEIGHT / HUD_ATLAS_HEIGHT;
+        push_hud_quad(x0, y0, x1, y1, u, v, u, v, color);
+}
+
+static void push_hud_text(int line, struct Unorm8Vec4 color, const char *fmt, ...)
+{
+        char text[HUD_COLUMNS + 1];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(text, sizeof text, fmt, ap);
+        va_end(ap);
+        float x = HUD_MARGIN;
+        float y = HUD_MARGIN + line * HUD_LINE_HEIGHT;
+        for (const char *s = text; *s; s++, x += HUD_CELL_WIDTH * HUD_SCALE) {
+                int c = (unsigned char) *s;
+                if ('a' <= c && c <= 'z')
+                        c += 'A' - 'a';
+                else if (c == ' ')
+                        continue;
+                else if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR)
+                        c = '?';
+                int cell = c - FONT_FIRST_CHAR;
+                float u0 = (float) (cell % HUD_ATLAS_COLUMNS * HUD_CELL_WIDTH) / HUD_ATLAS_WIDTH;
+                float v0 = (float) (cell / HUD_ATLAS_COLUMNS * HUD_CELL_HEIGHT) / HUD_ATLAS_HEIGHT;
+                push_hud_quad(x, y, x + FONT_GLYPH_WIDTH * HUD_SCALE, y + FONT_GLYPH_HEIGHT * HUD_SCALE,
+                              u0, v0,
+                              u0 + (float) FONT_GLYPH_WIDTH / HUD_ATLAS_WIDTH,
+                              v0 + (float) FONT_GLYPH_HEIGHT / HUD_ATLAS_HEIGHT, color);
+        }
+}
+
+static void push_hud_graph(void)
+{
+        static const struct Unorm8Vec4 fastColor = { 80, 200, 80, 220 };
+        static const struct Unorm8Vec4 slowColor = { 230, 70, 50, 220 };
+        static const struct Unorm8Vec4 gpuColor = { 240, 200, 60, 220 };
+        static const struct Unorm8Vec4 budgetColor = { 255, 255, 255, 120 };
+        float x0 = HUD_MARGIN;
+        float y1 = HUD_GRAPH_Y + HUD_GRAPH_HEIGHT;  // the bottom
+        float scale = HUD_GRAPH_HEIGHT / (2.f * frameBudgetMs);
+        for (int i = 0; i < HUD_GRAPH_LENGTH; i++) {
+                // oldest first
+                float frameMs = hudFrameMs[(hudFramePos + i) % HUD_GRAPH_LENGTH];
+                float gpuMs = hudGpuMs[(hudGpuPos + i) % HUD_GRAPH_LENGTH];
+                float x = x0 + i * HUD_GRAPH_BAR_WIDTH;
+                if (frameMs > 0.f)
+                        push_hud_rect(x, y1 - fminf(frameMs * scale, HUD_GRAPH_HEIGHT),
+                                      x + HUD_GRAPH_BAR_WIDTH - 1, y1,
+                                      frameMs > frameBudgetMs ? slowColor : fastColor);
+                // a tick at the GPU time, over the bar
+                if (gpuMs > 0.f) {
+                        float y = y1 - fminf(gpuMs * scale, HUD_GRAPH_HEIGHT);
+                        push_hud_rect(x, y, x + HUD_GRAPH_BAR_WIDTH, y + 2, gpuColor);
                 }
         }
-                CHECK_GL_ERRORS();
-        for (int i = 0; i < numLinkInfos; i++) {
-                int pi = smLinkInfo[i].programIndex;
-                int si = smLinkInfo[i].shaderIndex;
-                glAttachShader(gfxProgram[pi], gfxShader[si]);
+        float y = y1 - frameBudgetMs * scale;
+        push_hud_rect(x0, y, x0 + HUD_GRAPH_LENGTH * HUD_GRAPH_BAR_WIDTH, y + 1, budgetColor);
+}
+
+static void draw_hud(void)
+{
+        static const struct Unorm8Vec4 backgroundColor = { 0, 0, 0, 160 };
+        static const struct Unorm8Vec4 textColor = { 230, 230, 230, 255 };
+        if (!hudIsVisible || !poll_program(PROGRAM_text))
+                return;
+        TRACE_SCOPE("draw_hud");
+        uint64_t startNs = get_time_ns();
+        struct GfxStats stats;
+        get_gfx_stats(&stats);
+        float lastFrameMs = hudFrameMs[(hudFramePos + HUD_GRAPH_LENGTH - 1) % HUD_GRAPH_LENGTH];
+        float lastGpuMs = hudGpuMs[(hudGpuPos + HUD_GRAPH_LENGTH - 1) % HUD_GRAPH_LENGTH];
+        numHudVertices = 0;
+        push_hud_rect(0, 0, HUD_WIDTH, HUD_HEIGHT, backgroundColor);
+        push_hud_text(0, textColor, "FRAME %5.2f CPU %5.2f SWAP %5.2f GPU %5.2f MS",
+                      lastFrameMs, hudCpuMs, hudSwapMs, lastGpuMs);
+        push_hud_text(1, textColor, "SCALE %d%% MSAA %dX HUD %.3f MS",
+                      (int) (renderScaleSteps[renderScaleStep] * 100.f + 0.5f), msaaBufferSamples, hudDrawMs);
+        push_hud_text(2, textColor, "DRAWS %llu BINDS %llu/%llu VERTICES %llu",
+                      (unsigned long long) stats.numDrawCalls, (unsigned long long) stats.numProgramBinds,
+                      (unsigned long long) stats.numVaoBinds, (unsigned long long) stats.numVertices);
+        push_hud_text(3, textColor, "UPLOAD %llu B REALLOCS %llu EVENTS %llu/%llu LOST",
+                      (unsigned long long) stats.numBytesUploaded, (unsigned long long) stats.numReallocs,
+                      (unsigned long long) stats.numEvents, (unsigned long long) stats.numDroppedEvents);
+        push_hud_graph();
+        SET_ARRAY_BUFFER_DATA(hudVBO, hudVertices, numHudVertices);
+
+        textShader_set_screenSize((float) windowWidth, (float) windowHeight);
+        textShader_set_fontTexture(0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glBindTexture(GL_TEXTURE_2D, hudFontTexture);
+        make_draw_call(gfxProgram[PROGRAM_text], hudVAO, GL_TRIANGLES, 0, numHudVertices);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+        glEnable(GL_DEPTH_TEST);
+        glViewport(0, 0, renderWidth, renderHeight);
+        CHECK_GL_ERRORS();
+        hudDrawMs = (float) ns_to_ms(get_time_ns() - startNs);
+}
+
+/* Bake the font into a one-channel atlas texture. */
+static void setup_hud(void)
+{
+        static unsigned char atlas[HUD_ATLAS_HEIGHT][HUD_ATLAS_WIDTH];
+        for (int i = 0; i < NUM_FONT_GLYPHS; i++) {
+                int x0 = i % HUD_ATLAS_COLUMNS * HUD_CELL_WIDTH;
+                int y0 = i / HUD_ATLAS_COLUMNS * HUD_CELL_HEIGHT;
+                for (int y = 0; y < FONT_GLYPH_HEIGHT; y++)
+                        for (int x = 0; x < FONT_GLYPH_WIDTH; x++)
+                                if (fontGlyphs[i][y] & (1 << (FONT_GLYPH_WIDTH - 1 - x)))
+                                        atlas[y0 + y][x0 + x] = 255;
         }
-                CHECK_GL_ERRORS();
-        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
-                glLinkProgram(gfxProgram[i]);
+        int x0 = HUD_SOLID_CELL % HUD_ATLAS_COLUMNS * HUD_CELL_WIDTH;
+        int y0 = HUD_SOLID_CELL / HUD_ATLAS_COLUMNS * HUD_CELL_HEIGHT;
+        for (int y = 0; y < HUD_CELL_HEIGHT; y++)
+                memset(&atlas[y0 + y][x0], 255, HUD_CELL_WIDTH);
+        glGenTextures(1, &hudFontTexture);
+        glBindTexture(GL_TEXTURE_2D, hudFontTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, HUD_ATLAS_WIDTH, HUD_ATLAS_HEIGHT, 0,
+                     GL_RED, GL_UNSIGNED_BYTE, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // the glyphs are drawn at an integer scale, no filtering needed
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenBuffers(1, &hudVBO);
+        glGenVertexArrays(1, &hudVAO);
+        setup_text_vao(hudVAO, hudVBO);
+        const char *env = getenv("SEGMENTS_HUD");
+        hudIsVisible = env != NULL && atoi(env) != 0;
+        CHECK_GL_ERRORS();
+}
+
+/* (Re)create the cache textures for the current render size and the given
+number of samples. A texture can't change between GL_TEXTURE_2D and
+GL_TEXTURE_2D_MULTISAMPLE, so they are made anew. */
+static int allocate_shape_cache(int samples)
+{
+        GLuint textures[2] = { shapeCacheColorTexture, shapeCacheDepthTexture };
+        glDeleteTextures(2, textures);
+        glGenTextures(2, textures);
+        shapeCacheColorTexture = textures[0];
+        shapeCacheDepthTexture = textures[1];
+        GLenum target = samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+        if (samples > 0) {
+                // like the MSAA buffers, so the cache can be copied with glBlitFramebuffer()
+                glBindTexture(target, shapeCacheColorTexture);
+                glTexImage2DMultisample(target, samples, GL_RGBA8, renderWidth, renderHeight, GL_TRUE);
+                glBindTexture(target, shapeCacheDepthTexture);
+                glTexImage2DMultisample(target, samples, GL_DEPTH_COMPONENT24, renderWidth, renderHeight, GL_TRUE);
         }
-        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
-		if (!get_link_status(i))
-                        fatal_f("Failed to link!");
+        else {
+                glBindTexture(target, shapeCacheColorTexture);
+                // no mipmaps, otherwise the textures are incomplete
+                glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexImage2D(target, 0, GL_RGBA8, renderWidth, renderHeight, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glBindTexture(target, shapeCacheDepthTexture);
+                glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, renderWidth, renderHeight, 0,
+                             GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        }
+        glBindTexture(target, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, shapeCacheFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, shapeCacheColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target, shapeCacheDepthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CHECK_GL_ERRORS();
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+                LOG_WARNING(LOGCATEGORY_GFX, "Shape cache framebuffer with %d samples is incomplete (0x%x), drawing shapes directly",
+                                             samples, status);
+                return 0;
+        }
+        return 1;
+}
+
+/* Called by update_msaa_buffers(): the cache gets the render size and the
+samples of the MSAA buffers (0 if the scene is drawn into the window). */
+static void reallocate_shape_cache(void)
+{
+        shapeCacheIsValid = 0;
+        shapeCacheWidth = 0;
+        shapeCacheHeight = 0;
+        if (!haveShapeCache || renderWidth <= 0 || renderHeight <= 0)
+                return;
+        if (!allocate_shape_cache(msaaBufferSamples)) {
+                haveShapeCache = 0;
+                return;
+        }
+        shapeCacheWidth = renderWidth;
+        shapeCacheHeight = renderHeight;
+        shapeCacheSamples = msaaBufferSamples;
+}
+
+/* Redraw the committed shapes into the cache if it is out of date. Returns
+whether the cache can be used. */
+static int update_shape_cache(void)
+{
+        TRACE_SCOPE("update_shape_cache");
+        if (!haveShapeCache || renderWidth != shapeCacheWidth || renderHeight != shapeCacheHeight
+            || shapeCacheWidth <= 0 || shapeCacheHeight <= 0)
+                return 0;
+        if (memcmp(&shapeCacheTransform, &screenTransform, sizeof screenTransform)) {
+                shapeCacheTransform = screenTransform;
+                shapeCacheIsValid = 0;
         }
+        if (shapeCacheIsValid)
+                return 1;
+        int useTiles = haveShapeTiles && numShapeInstances >= MIN_SHAPES_FOR_TILES && update_shape_tiles();
+        glBindFramebuffer(GL_FRAMEBUFFER, shapeCacheFBO);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (useTiles)
+                draw_shape_tiles();
+        else
+                make_instanced_draw_call(gfxProgram[PROGRAM_shape], shapeVAO, GL_TRIANGLES, 6, numShapeInstances);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CHECK_GL_ERRORS();
+        shapeCacheIsValid = 1;
+        return 1;
+}
+
+/* Copy the color and depth of the cached shapes to the framebuffer. The
+shapes were already blended against the clear color, which the
+framebuffer is also cleared to. A multisampled cache has the size, samples
+and formats of the MSAA buffers, so each sample is copied with a blit (which
+is clipped to the scissor rect, like drawing). */
+static void composite_shape_cache(void)
+{
+        if (shapeCacheSamples > 0) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, shapeCacheFBO);
+                glBlitFramebuffer(0, 0, shapeCacheWidth, shapeCacheHeight, 0, 0, shapeCacheWidth, shapeCacheHeight,
+                                  GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
                 CHECK_GL_ERRORS();
-        for (int i = 0; i < NUM_ATTRIBUTE_KINDS; i++) {
-                int pi = smAttributeInfo[i].programIndex;
-                const char *name = smAttributeInfo[i].name;
-                gfxAttributeLocation[i] = glGetAttribLocation(gfxProgram[pi], name);
-                if (gfxAttributeLocation[i] == -1) {
-                        message_f("Warning: Shader '%s', attribute '%s' not available",
-                                  smProgramInfo[pi].name, name);
+                return;
+        }
+        ensure_program(PROGRAM_composite);
+        // set every time, a reloaded program starts with all samplers on unit 0
+        compositeShader_set_colorTexture(0);
+        compositeShader_set_depthTexture(1);
+        glDisable(GL_BLEND);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glBindTexture(GL_TEXTURE_2D, shapeCacheColorTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, shapeCacheDepthTexture);
+        make_draw_call(gfxProgram[PROGRAM_composite], compositeVAO, GL_TRIANGLES, 0, 3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+        glEnable(GL_BLEND);
+        CHECK_GL_ERRORS();
+}
+
+// The textures are made by allocate_shape_cache()
+static void setup_shape_cache(void)
+{
+        glGenFramebuffers(1, &shapeCacheFBO);
+        glGenVertexArrays(1, &compositeVAO);
+        haveShapeCache = 1;
+}
+
+/* Called by update_msaa_buffers() when the number of samples changes. The
+tiles in the atlas were resolved from the old number of samples. */
+static void update_shape_tile_samples(void)
+{
+        invalidate_shape_tiles();
+        tileSamples = 0;
+        if (!haveShapeTiles || msaaBufferSamples == 0)
+                return;
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tileMsaaColorTexture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msaaBufferSamples, GL_RGBA8,
+                                TILE_SIZE, TILE_SIZE, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tileMsaaDepthTexture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msaaBufferSamples, GL_DEPTH_COMPONENT24,
+                                TILE_SIZE, TILE_SIZE, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, tileMsaaFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, tileMsaaColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, tileMsaaDepthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, tileResolveFBO);
+        GLenum resolveStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        CHECK_GL_ERRORS();
+        if (status != GL_FRAMEBUFFER_COMPLETE || resolveStatus != GL_FRAMEBUFFER_COMPLETE) {
+                LOG_WARNING(LOGCATEGORY_GFX, "Tile framebuffers with %d samples are incomplete (0x%x, 0x%x), drawing tiles without MSAA",
+                                             msaaBufferSamples, status, resolveStatus);
+                return;
+        }
+        tileSamples = msaaBufferSamples;
+}
+
+static void setup_shape_tiles(void)
+{
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        tileAtlasColorTexture = textures[0];
+        tileAtlasDepthTexture = textures[1];
+        glBindTexture(GL_TEXTURE_2D, tileAtlasColorTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TILE_ATLAS_SIZE, TILE_ATLAS_SIZE, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, tileAtlasDepthTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, TILE_ATLAS_SIZE, TILE_ATLAS_SIZE, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &tileAtlasFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, tileAtlasFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tileAtlasColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tileAtlasDepthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+                // the frame cache is drawn shape by shape then
+                LOG_WARNING(LOGCATEGORY_GFX, "Tile atlas framebuffer is incomplete (0x%x)", status);
+                haveShapeTiles = 0;
+                return;
+        }
+        glGenBuffers(1, &tileVBO);
+        glGenVertexArrays(1, &tileVAO);
+        setup_tile_vao(tileVAO, tileVBO);
+        glGenBuffers(1, &newShapesVBO);
+        glGenVertexArrays(1, &newShapesVAO);
+        setup_shape_vao(newShapesVAO, newShapesVBO);
+        set_instanced_attributes(PROGRAM_shape, newShapesVAO);
+        // the multisampled tile is allocated by update_shape_tile_samples()
+        GLuint msaaTextures[2];
+        glGenTextures(2, msaaTextures);
+        tileMsaaColorTexture = msaaTextures[0];
+        tileMsaaDepthTexture = msaaTextures[1];
+        glGenFramebuffers(1, &tileMsaaFBO);
+        glGenTextures(1, &tileResolveTexture);
+        glBindTexture(GL_TEXTURE_2D, tileResolveTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TILE_SIZE, TILE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &tileResolveFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, tileResolveFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tileResolveTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        haveShapeTiles = 1;
+}
+
+static const struct {
+        void **funcptr;
+        const char *name;
+} procsToLoad[] = {
+#define MAKE(type, name) { (void**)&name, #name },
+#include <segments/openglprocs.h>
+#undef MAKE
+};
+
+static const int shadertypeMap[NUM_SHADERTYPE_KINDS] = {
+        [SHADERTYPE_VERTEX] = GL_VERTEX_SHADER,
+        [SHADERTYPE_FRAGMENT] = GL_FRAGMENT_SHADER,
+};
+
+static int get_compile_status(GLuint shader, const char *name)
+{
+        GLint compileStatus;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
+        if (compileStatus != GL_TRUE) {
+                GLchar errorBuf[1024];
+                GLsizei length;
+                glGetShaderInfoLog(shader, sizeof errorBuf, &length, errorBuf);
+                LOG_WARNING(LOGCATEGORY_SHADERS, "shader '%s' failed to compile: %s",
+                                                 name, errorBuf);
+        }
+        return compileStatus == GL_TRUE;
+}
+
+static int get_link_status(GLuint program, const char *name)
+{
+        GLint linkStatus;
+        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus != GL_TRUE) {
+                GLsizei length;
+                GLchar errorBuf[128];
+                glGetProgramInfoLog(program, sizeof errorBuf,
+                        &length, errorBuf);
+                LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to link shader program '%s': %s",
+                                                 name, errorBuf);
+        }
+        return linkStatus == GL_TRUE;
+}
+
+int have_gl_extension(const char *name)
+{
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (int i = 0; i < numExtensions; i++)
+                if (!strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), name))
+                        return 1;
+        return 0;
+}
+
+static int is_eager_program(int programIndex)
+{
+        return smProgramInfo[programIndex].baseProgramIndex == programIndex;
+}
+
+/* Create a program object and start compiling and linking it. The shaders of
+a program variant are those of the program that it is a variant of, with the
+#define's of the variant inserted after the #version line. The created shader
+objects are stored in shaders[]. */
+static GLuint create_program(int programIndex, GLuint *shaders)
+{
+        const struct SM_ProgramInfo *info = &smProgramInfo[programIndex];
+        GLuint program = glCreateProgram();
+        if (program == 0) {
+                fatal_f("glCreateProgram() failed");
+        }
+        int numShaders = 0;
+        for (int i = 0; i < numLinkInfos; i++) {
+                if (smLinkInfo[i].programIndex != info->baseProgramIndex)
+                        continue;
+                int shaderIndex = smLinkInfo[i].shaderIndex;
+                const struct SM_ShaderInfo *shaderInfo = &smShaderInfo[shaderIndex];
+                int sourceSize;
+                const char *source = get_reloaded_shader_source(shaderIndex, &sourceSize);
+                if (source == NULL) {
+                        source = shaderInfo->shaderSource;
+                        sourceSize = shaderInfo->shaderSourceSize;
                 }
+                const char *endOfVersion = memchr(source, '\n', sourceSize);
+                int versionSize = endOfVersion ? (int) (endOfVersion - source) + 1 : 0;
+                const char *strings[3] = { source, info->defines, source + versionSize };
+                GLint lengths[3] = { versionSize, (GLint) strlen(info->defines), sourceSize - versionSize };
+                GLuint shader = glCreateShader(shadertypeMap[shaderInfo->shadertypeKind]);
+                glShaderSource(shader, 3, strings, lengths);
+                glCompileShader(shader);
+                glAttachShader(program, shader);
+                ENSURE(numShaders < MAX_SHADERS_PER_PROGRAM);
+                shaders[numShaders++] = shader;
         }
-                CHECK_GL_ERRORS();
+        for (int i = 0; i < NUM_ATTRIBUTE_KINDS; i++) {
+                if (smAttributeInfo[i].programIndex == info->baseProgramIndex)
+                        glBindAttribLocation(program, smAttributeInfo[i].location, smAttributeInfo[i].name);
+        }
+        // the output of every fragment shader
+        glBindFragDataLocation(program, 0, "fragColor");
+        // needed by some drivers to make glGetProgramBinary() work
+        if (glProgramParameteri)
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        CHECK_GL_ERRORS();
+        return program;
+}
+
+static void start_program(int programIndex)
+{
+        gfxProgram[programIndex] = create_program(programIndex, programShaders[programIndex]);
+        programStartTime[programIndex] = get_time_ns();
+}
+
+/* Start compiling and linking all programs that were not loaded from the
+cache. Their status is not checked here, because that would make us wait for
+the compiler. With GL_KHR_parallel_shader_compile the driver compiles in
+background threads, and we check each program only when it is first needed,
+in ensure_program(). */
+static void compile_and_link_programs(void)
+{
+        TRACE_SCOPE("compile_and_link_programs");
+        if (have_gl_extension("GL_KHR_parallel_shader_compile")) {
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                haveParallelShaderCompile = 1;
+        }
+        else if (have_gl_extension("GL_ARB_parallel_shader_compile")) {
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                haveParallelShaderCompile = 1;
+        }
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                if (is_eager_program(i) && gfxProgram[i] == 0)
+                        start_program(i);
+        }
+}
+
+/* The attribute locations are bound before linking (see
+compile_and_link_programs()), but the uniform locations can only be queried
+from the linked program. GLSL 3.30 has no way to specify them. */
+static void query_uniform_locations(int programIndex)
+{
+        int base = smProgramInfo[programIndex].baseProgramIndex;
         for (int i = 0; i < NUM_UNIFORM_KINDS; i++) {
-                int pi = smUniformInfo[i].programIndex;
                 const char *name = smUniformInfo[i].name;
-                gfxUniformLocation[i] = glGetUniformLocation(gfxProgram[pi], name);
-                if (gfxUniformLocation[i] == -1) {
-                        message_f("Warning: Shader '%s', attribute '%s' not available",
-                                  smProgramInfo[pi].name, name);
+                if (smUniformInfo[i].programIndex != base)
+                        continue;
+                // the uniforms of each program are contiguous
+                int location = smProgramInfo[programIndex].firstUniformLocation
+                        + i - smProgramInfo[base].firstUniformLocation;
+                gfxUniformLocation[location] = glGetUniformLocation(gfxProgram[programIndex], name);
+                if (gfxUniformLocation[location] == -1) {
+                        LOG_WARNING(LOGCATEGORY_SHADERS, "Shader '%s', uniform '%s' not available",
+                                                         smProgramInfo[programIndex].name, name);
                 }
         }
                 CHECK_GL_ERRORS();
+}
 
-                CHECK_GL_ERRORS();
+/* Link errors are often only "see compile log". */
+static void print_compile_logs(int programIndex, const GLuint *shaders)
+{
+        int base = smProgramInfo[programIndex].baseProgramIndex;
+        for (int i = 0, j = 0; i < numLinkInfos; i++) {
+                if (smLinkInfo[i].programIndex != base)
+                        continue;
+                GLuint shader = shaders[j++];
+                if (shader != 0)
+                        get_compile_status(shader, smShaderInfo[smLinkInfo[i].shaderIndex].name);
+        }
+}
 
-        glGenBuffers(1, &lineVBO);
-        glGenVertexArrays(1, &lineVAO);
-        SET_ATTRIBPOINTER_line_position (lineVAO, lineVBO, struct LineVertex, position);
-        SET_ATTRIBPOINTER_line_normal   (lineVAO, lineVBO, struct LineVertex, normal);
-        SET_ATTRIBPOINTER_line_color    (lineVAO, lineVBO, struct LineVertex, color);
+/* Wait for the program to finish linking (if necessary), check that linking
+succeeded, and do the setup that depends on the linked program. */
+static void ensure_program(int programIndex)
+{
+        if (programIsReady[programIndex])
+                return;
+        // this is where we wait for the compiler
+        TRACE_SCOPE("ensure_program");
+        if (gfxProgram[programIndex] == 0)
+                start_program(programIndex);
+        if (!get_link_status(gfxProgram[programIndex], smProgramInfo[programIndex].name)) {
+                print_compile_logs(programIndex, programShaders[programIndex]);
+                fatal_f("Failed to link!");
+        }
+        query_uniform_locations(programIndex);
         CHECK_GL_ERRORS();
+        programIsReady[programIndex] = 1;
+        if (!programIsCached[programIndex])
+                programsNeedStoring = 1;
+        if (!is_eager_program(programIndex)) {
+                LOG_INFO(LOGCATEGORY_SHADERS, "Program '%s' ready after %.2f ms (%s)", smProgramInfo[programIndex].name,
+                                              ns_to_ms(get_time_ns() - programStartTime[programIndex]),
+                                              programIsCached[programIndex] ? "cached" : "compiled");
+        }
+        else if (++numEagerProgramsReady == numEagerPrograms) {
+                LOG_INFO(LOGCATEGORY_SHADERS, "All %d programs ready after %.2f ms (%s)", numEagerPrograms,
+                                              ns_to_ms(get_time_ns() - programsStartTime),
+                                              programsFromCache ? "cached" : "compiled");
+        }
+        // variants that become ready later are added to the cache then
+        // reloaded shaders don't match the cache key, which is made from the embedded ones
+        if (numEagerProgramsReady == numEagerPrograms && programsNeedStoring && !haveReloadedShaders) {
+                store_programs_in_cache(programIsReady);
+                programsNeedStoring = 0;
+        }
+}
 
-        glGenBuffers(1, &circleVBO);
-        glGenVertexArrays(1, &circleVAO);
-        SET_ATTRIBPOINTER_circle_centerPoint (circleVAO, circleVBO, struct CircleVertex, centerPoint);
-        SET_ATTRIBPOINTER_circle_diff        (circleVAO, circleVBO, struct CircleVertex, diff);
-        SET_ATTRIBPOINTER_circle_color       (circleVAO, circleVBO, struct CircleVertex, color);
-        SET_ATTRIBPOINTER_circle_radius      (circleVAO, circleVBO, struct CircleVertex, radius);
-        CHECK_GL_ERRORS();
+/* Like ensure_program(), but doesn't wait. Returns whether the program is
+ready. Variants that aren't started yet get started. */
+static int poll_program(int programIndex)
+{
+        if (programIsReady[programIndex])
+                return 1;
+        if (gfxProgram[programIndex] == 0)
+                start_program(programIndex);
+        if (haveParallelShaderCompile) {
+                GLint isComplete;
+                glGetProgramiv(gfxProgram[programIndex], GL_COMPLETION_STATUS_KHR, &isComplete);
+                if (!isComplete)
+                        return 0;
+        }
+        ensure_program(programIndex);
+        return 1;
+}
+
+/* Finish the setup of the programs that are done compiling, even if they
+aren't used (yet), so they can go into the cache. */
+static void poll_started_programs(void)
+{
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++)
+                if (gfxProgram[i] != 0 && !programIsReady[i])
+                        poll_program(i);
+}
 
-        glGenBuffers(1, &arcVBO);
-        glGenVertexArrays(1, &arcVAO);
-        SET_ATTRIBPOINTER_arc_startPoint  (arcVAO, arcVBO, struct ArcVertex, startPoint);
-        SET_ATTRIBPOINTER_arc_centerPoint (arcVAO, arcVBO, struct ArcVertex, centerPoint);
-        SET_ATTRIBPOINTER_arc_position    (arcVAO, arcVBO, struct ArcVertex, position);
-        SET_ATTRIBPOINTER_arc_color       (arcVAO, arcVBO, struct ArcVertex, color);
-        SET_ATTRIBPOINTER_arc_diffAngle   (arcVAO, arcVBO, struct ArcVertex, diffAngle);
-        SET_ATTRIBPOINTER_arc_radius      (arcVAO, arcVBO, struct ArcVertex, radius);
+static void delete_program_and_shaders(GLuint program, GLuint *shaders)
+{
+        glDeleteProgram(program);
+        for (int i = 0; i < MAX_SHADERS_PER_PROGRAM; i++) {
+                if (shaders[i] != 0)
+                        glDeleteShader(shaders[i]);
+                shaders[i] = 0;
+        }
+}
+
+/* Rebuild the programs whose shader files changed. The new programs are
+compiled in the background (if the driver can do that), and replace the old
+ones only when they have linked successfully. Otherwise the old ones are kept,
+so a typo doesn't end the session. */
+static void reload_changed_programs(void)
+{
+        TRACE_SCOPE("reload_changed_programs");
+        int changedShaders[NUM_SHADER_KINDS] = { 0 };
+        if (check_shader_files(changedShaders)) {
+                haveReloadedShaders = 1;
+                for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                        // variants that aren't started yet will use the new sources
+                        if (gfxProgram[i] == 0)
+                                continue;
+                        int isAffected = 0;
+                        for (int j = 0; j < numLinkInfos; j++)
+                                if (smLinkInfo[j].programIndex == smProgramInfo[i].baseProgramIndex
+                                    && changedShaders[smLinkInfo[j].shaderIndex])
+                                        isAffected = 1;
+                        if (!isAffected)
+                                continue;
+                        if (reloadingProgram[i] != 0)
+                                delete_program_and_shaders(reloadingProgram[i], reloadingShaders[i]);
+                        reloadingProgram[i] = create_program(i, reloadingShaders[i]);
+                }
+        }
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                GLuint program = reloadingProgram[i];
+                if (program == 0)
+                        continue;
+                if (haveParallelShaderCompile) {
+                        GLint isComplete;
+                        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &isComplete);
+                        if (!isComplete)
+                                continue;
+                }
+                reloadingProgram[i] = 0;
+                if (!get_link_status(program, smProgramInfo[i].name)) {
+                        print_compile_logs(i, reloadingShaders[i]);
+                        LOG_INFO(LOGCATEGORY_SHADERS, "Keeping the old version of program '%s'", smProgramInfo[i].name);
+                        delete_program_and_shaders(program, reloadingShaders[i]);
+                        continue;
+                }
+                delete_program_and_shaders(gfxProgram[i], programShaders[i]);
+                gfxProgram[i] = program;
+                COPY_MEMORY(programShaders[i], reloadingShaders[i], MAX_SHADERS_PER_PROGRAM);
+                memset(reloadingShaders[i], 0, sizeof reloadingShaders[i]);
+                // if the program isn't ready yet, this happens in ensure_program()
+                if (programIsReady[i])
+                        query_uniform_locations(i);
+                // the shapes might look different now
+                shapeCacheIsValid = 0;
+                invalidate_shape_tiles();
+                windowIsDamaged = 1;
+                LOG_INFO(LOGCATEGORY_SHADERS, "Reloaded program '%s'", smProgramInfo[i].name);
+        }
+}
+
+void setup_opengl(void)
+{
+        TRACE_SCOPE("setup_opengl");
         CHECK_GL_ERRORS();
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        //glDisable(GL_MULTISAMPLE);
+
+                        CHECK_GL_ERRORS();
+        for (int i = 0; i < sizeof procsToLoad / sizeof procsToLoad[0]; i++) {
+                const char *name = procsToLoad[i].name;
+                *procsToLoad[i].funcptr = load_opengl_pointer(name);
+        }
+                CHECK_GL_ERRORS();
+        setup_gfx_stats();
+        programsStartTime = get_time_ns();
+        programsFromCache = load_programs_from_cache();
+        // after loading the cache, which expects errors for binaries that the
+        // driver doesn't take anymore
+        if (!setup_gl_debug_output())
+                LOG_WARNING(LOGCATEGORY_GL, "GL_KHR_debug is not supported, no driver messages");
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                programIsCached[i] = gfxProgram[i] != 0;
+                programStartTime[i] = programsStartTime;
+                if (is_eager_program(i))
+                        numEagerPrograms++;
+        }
+        haveShaderReload = start_watching_shader_files();
+        compile_and_link_programs();
+        LOG_INFO(LOGCATEGORY_SHADERS, "Started setting up %d programs in %.2f ms (%s%s)", numEagerPrograms,
+                                      ns_to_ms(get_time_ns() - programsStartTime),
+                                      programsFromCache ? "cached" : "compiling",
+                                      haveParallelShaderCompile ? ", parallel" : "");
+                CHECK_GL_ERRORS();
 
+        glGenBuffers(1, &shapeVBO);
+        glGenVertexArrays(1, &shapeVAO);
+        glGenBuffers(1, &previewVBO);
+        glGenVertexArrays(1, &previewVAO);
         glGenBuffers(1, &v3VBO);
         glGenVertexArrays(1, &v3VAO);
-        SET_ATTRIBPOINTER_v3_position  (v3VAO, v3VBO, struct V3Vertex, position);
-        SET_ATTRIBPOINTER_v3_normal    (v3VAO, v3VBO, struct V3Vertex, normal);
-        SET_ATTRIBPOINTER_v3_color     (v3VAO, v3VBO, struct V3Vertex, color);
+        // the attribute locations are known in advance, no need to wait for the programs
+        setup_shape_vao(shapeVAO, shapeVBO);
+        set_instanced_attributes(PROGRAM_shape, shapeVAO);
+        setup_shape_vao(previewVAO, previewVBO);
+        set_instanced_attributes(PROGRAM_shape, previewVAO);
+        setup_v3_vao(v3VAO, v3VBO);
+        haveUploadWorker = start_upload_worker();
+        setup_shape_cache();
+        setup_shape_tiles();
+        setup_msaa();
+        setup_dynamic_resolution();
+        setup_hud();
+        setup_latency();
         CHECK_GL_ERRORS();
 }
@@ -0,0 +1,137 @@
+#include <segments/defs.h>
+#include <segments/gldebug.h>
+#include <segments/logging.h>
+#include <segments/opengl.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+        MAX_REPORTS_PER_MESSAGE = 5,
+        NUM_MESSAGE_COUNTERS = 128,  // must be a power of 2
+};
+
+/* How often each message (by source, type and ID) was reported. With
+asynchronous output the callback can run on several threads at once. The
+table never moves and the slots are only ever claimed, so a race can only
+make a count inexact. */
+struct MessageCounter {
+        GLenum source;
+        GLenum type;
+        GLuint id;
+        int count;
+};
+
+static struct MessageCounter messageCounters[NUM_MESSAGE_COUNTERS];
+
+static const struct {
+        const char *name;
+        GLenum severity;
+} severityNames[] = {
+        { "high", GL_DEBUG_SEVERITY_HIGH },
+        { "medium", GL_DEBUG_SEVERITY_MEDIUM },
+        { "low", GL_DEBUG_SEVERITY_LOW },
+        { "notification", GL_DEBUG_SEVERITY_NOTIFICATION },
+};
+
+static const char *get_source_name(GLenum source)
+{
+        switch (source) {
+        case GL_DEBUG_SOURCE_API: return "API";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+        }
+}
+
+static const char *get_type_name(GLenum type)
+{
+        switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "GL error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated behavior";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "Undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "Portability warning";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "Performance warning";
+        case GL_DEBUG_TYPE_MARKER: return "Marker";
+        default: return "GL message";
+        }
+}
+
+static const char *get_severity_name(GLenum severity)
+{
+        for (int i = 0; i < LENGTH(severityNames); i++)
+                if (severityNames[i].severity == severity)
+                        return severityNames[i].name;
+        return "unknown";
+}
+
+// Returns how often the message was reported before, counting this time
+static int count_message(GLenum source, GLenum type, GLuint id)
+{
+        unsigned hash = (id * 2654435761u) ^ (source << 4) ^ type;
+        for (int i = 0; i < NUM_MESSAGE_COUNTERS; i++) {
+                struct MessageCounter *c = &messageCounters[(hash + i) & (NUM_MESSAGE_COUNTERS - 1)];
+                if (c->count == 0) {
+                        c->source = source;
+                        c->type = type;
+                        c->id = id;
+                }
+                else if (c->source != source || c->type != type || c->id != id)
+                        continue;
+                return ++c->count;
+        }
+        // table full, don't limit
+        return 1;
+}
+
+static void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                    GLsizei length, const GLchar *message, const void *userParam)
+{
+        (void) length;
+        (void) userParam;
+        int count = count_message(source, type, id);
+        if (count > MAX_REPORTS_PER_MESSAGE)
+                return;
+        int loglevelKind;
+        if (type == GL_DEBUG_TYPE_ERROR || type == GL_DEBUG_TYPE_PERFORMANCE
+            || severity == GL_DEBUG_SEVERITY_HIGH)
+                loglevelKind = LOGLEVEL_WARNING;
+        else if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+                loglevelKind = LOGLEVEL_DEBUG;
+        else
+                loglevelKind = LOGLEVEL_INFO;
+        // limited by message ID above, not by call site
+        log_f(NULL, loglevelKind, LOGCATEGORY_GL, "%s (%s, %s severity, ID %u): %s%s",
+              get_type_name(type), get_source_name(source), get_severity_name(severity), id, message,
+              count == MAX_REPORTS_PER_MESSAGE ? " (not reported again)" : "");
+}
+
+int setup_gl_debug_output(void)
+{
+        if (!have_gl_extension("GL_KHR_debug"))
+                return 0;
+        int minSeverity = 2;  // low
+        const char *env = getenv("SEGMENTS_GL_DEBUG_SEVERITY");
+        if (env != NULL) {
+                int i = 0;
+                while (i < LENGTH(severityNames) && strcmp(env, severityNames[i].name))
+                        i++;
+                if (i < LENGTH(severityNames))
+                        minSeverity = i;
+                else
+                        LOG_WARNING(LOGCATEGORY_GL, "Unknown GL debug severity '%s'", env);
+        }
+        for (int i = 0; i < LENGTH(severityNames); i++)
+                glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severityNames[i].severity,
+                                      0, NULL, i <= minSeverity ? GL_TRUE : GL_FALSE);
+        // performance warnings are what we are most interested in besides errors
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PERFORMANCE, GL_DEBUG_SEVERITY_LOW,
+                              0, NULL, GL_TRUE);
+        glDebugMessageCallback(debug_callback, NULL);
+        // asynchronous, the driver doesn't need to wait for us
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glEnable(GL_DEBUG_OUTPUT);
+        return 1;
+}
@@ -1,9 +1,11 @@
 #include <segments/defs.h>
 #include <segments/logging.h>
 #include <segments/opengl.h>
+#include <segments/trace.h>
 #include <segments/window.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <X11/Xlib.h>
 #include <X11/XKBlib.h>
@@ -15,31 +17,122 @@
 static const int initialWindowWidth = 800;
 static const int initialWindowHeight = 600;
 
-static GLint att[] = {
-        GLX_RGBA,
+#ifndef GLX_CONTEXT_OPENGL_NO_ERROR_ARB
+#define GLX_CONTEXT_OPENGL_NO_ERROR_ARB 0x31B3
+#endif
+
+static const int fbConfigAttribs[] = {
+        GLX_X_RENDERABLE, True,
+        GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+        GLX_RENDER_TYPE, GLX_RGBA_BIT,
+        GLX_RED_SIZE, 8,
+        GLX_GREEN_SIZE, 8,
+        GLX_BLUE_SIZE, 8,
         GLX_DEPTH_SIZE, 24,
-        GLX_DOUBLEBUFFER,
-        GLX_SAMPLE_BUFFERS, 1, // <-- MSAA
-        GLX_SAMPLES, 4, // <-- MSAA
+        GLX_DOUBLEBUFFER, True,
+        // no MSAA, that is done in an offscreen framebuffer (see gfx.c)
+        None,
+};
+
+/* A 3.3 core context. Release builds ask for GLX_ARB_create_context_no_error,
+which lets the driver skip its error checks (glGetError() is not called
+then, see CHECK_GL_ERRORS() in gfx.c). Other builds get a debug context, so
+that the driver reports everything it can through GL_KHR_debug. The slot
+before the terminator is filled in by choose_context_flags(). */
+static int contextAttribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+        GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+        None, None,
         None,
 };
 
 static Display *display;
 static Window rootWin;
 static Window window;
+static GLXFBConfig fbConfig;
 static XVisualInfo *visualInfo;
 static Colormap colormap;
 static GLXContext contextGlx;
+static Window uploadWindow;  // never mapped, the upload context needs a drawable
+static GLXContext uploadContextGlx;
+static int haveBufferAge;
+static PFNGLXCREATECONTEXTATTRIBSARBPROC glXCreateContextAttribsARB;
+static int contextCreationFailed;
+
+static int have_glx_extension(const char *name)
+{
+        const char *extensions = glXQueryExtensionsString(display, DefaultScreen(display));
+        if (extensions == NULL)
+                return 0;
+        size_t length = strlen(name);
+        for (const char *p = extensions; (p = strstr(p, name)) != NULL; p += length)
+                if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+                        return 1;
+        return 0;
+}
+
+static void choose_context_flags(void)
+{
+        int *slot = &contextAttribs[LENGTH(contextAttribs) - 3];
+#ifdef NDEBUG
+        if (have_glx_extension("GLX_ARB_create_context_no_error")) {
+                slot[0] = GLX_CONTEXT_OPENGL_NO_ERROR_ARB;
+                slot[1] = True;
+        }
+#else
+        slot[0] = GLX_CONTEXT_FLAGS_ARB;
+        slot[1] = GLX_CONTEXT_DEBUG_BIT_ARB;
+#endif
+}
+
+// X reports a failed glXCreateContextAttribsARB() as an error, which would
+// end the program by default
+static int on_context_creation_error(Display *display, XErrorEvent *event)
+{
+        (void) display;
+        (void) event;
+        contextCreationFailed = 1;
+        return 0;
+}
+
+static GLXContext create_context(GLXContext shareContext)
+{
+        contextCreationFailed = 0;
+        int (*oldHandler)(Display *, XErrorEvent *) = XSetErrorHandler(on_context_creation_error);
+        GLXContext context = glXCreateContextAttribsARB(display, fbConfig, shareContext, True, contextAttribs);
+        XSync(display, False);
+        XSetErrorHandler(oldHandler);
+        if (contextCreationFailed)
+                return NULL;
+        return context;
+}
 
 void create_opengl_context(void)
 {
+        // the upload context is made current on another thread
+        if (!XInitThreads())
+                LOG_WARNING(LOGCATEGORY_WINDOW, "XInitThreads() failed");
         display = XOpenDisplay(NULL);
         if (display == NULL)
                 fatal_f("Failed to XOpenDisplay()");
 
         rootWin = DefaultRootWindow(display);
 
-        visualInfo = glXChooseVisual(display, 0, att);
+        if (!have_glx_extension("GLX_ARB_create_context")
+            || !have_glx_extension("GLX_ARB_create_context_profile"))
+                fatal_f("GLX_ARB_create_context_profile is not supported, can't create a core context");
+        glXCreateContextAttribsARB = (PFNGLXCREATECONTEXTATTRIBSARBPROC)
+                glXGetProcAddressARB((const GLubyte *) "glXCreateContextAttribsARB");
+
+        int numFbConfigs;
+        GLXFBConfig *fbConfigs = glXChooseFBConfig(display, DefaultScreen(display),
+                                                   fbConfigAttribs, &numFbConfigs);
+        if (fbConfigs == NULL || numFbConfigs == 0)
+                fatal_f("No appropriate framebuffer configuration found");
+        fbConfig = fbConfigs[0];
+        XFree(fbConfigs);
+        visualInfo = glXGetVisualFromFBConfig(display, fbConfig);
         if (visualInfo == NULL)
                 fatal_f("No appropriate visual found");
 
@@ -51,7 +144,8 @@ void create_opengl_context(void)
         wa.event_mask = ExposureMask
                 | KeyPressMask | KeyReleaseMask
                 | ButtonPressMask | ButtonReleaseMask
-                | PointerMotionMask;
+                | PointerMotionMask
+                | StructureNotifyMask;
 
         window = XCreateWindow(display, rootWin, 0, 0,
                                initialWindowWidth, initialWindowHeight,
@@ -62,13 +156,54 @@ void create_opengl_context(void)
         XMapWindow(display, window);
         XStoreName(display, window, "segments");
 
-        contextGlx = glXCreateContext(display, visualInfo, NULL, GL_TRUE);
-        glXMakeCurrent(display, window, contextGlx);
+        choose_context_flags();
+        contextGlx = create_context(NULL);
+        if (contextGlx == NULL && contextAttribs[LENGTH(contextAttribs) - 3] != None) {
+                LOG_WARNING(LOGCATEGORY_GL, "Failed to create a context with flags, trying without");
+                contextAttribs[LENGTH(contextAttribs) - 3] = None;
+                contextGlx = create_context(NULL);
+        }
+        if (contextGlx == NULL)
+                fatal_f("Failed to create an OpenGL 3.3 core context");
+        if (!glXMakeCurrent(display, window, contextGlx))
+                fatal_f("Failed to glXMakeCurrent()");
+
+        haveBufferAge = have_glx_extension("GLX_EXT_buffer_age");
+}
+
+int create_upload_context(void)
+{
+        XSetWindowAttributes wa;
+        wa.colormap = colormap;
+        uploadWindow = XCreateWindow(display, rootWin, 0, 0, 1, 1, 0, visualInfo->depth,
+                                     InputOutput, visualInfo->visual, CWColormap, &wa);
+        // the flags must match those of the context it shares with
+        uploadContextGlx = create_context(contextGlx);
+        if (uploadContextGlx == NULL) {
+                XDestroyWindow(display, uploadWindow);
+                return 0;
+        }
+        return 1;
+}
+
+int make_upload_context_current(void)
+{
+        return glXMakeCurrent(display, uploadWindow, uploadContextGlx);
+}
+
+void release_upload_context(void)
+{
+        glXMakeCurrent(display, None, NULL);
 }
 
 void close_window(void)
 {
         glXMakeCurrent(display, None, NULL);
+        // released by the worker in stop_upload_worker()
+        if (uploadContextGlx != NULL) {
+                glXDestroyContext(display, uploadContextGlx);
+                XDestroyWindow(display, uploadWindow);
+        }
         glXDestroyContext(display, contextGlx);
         XDestroyWindow(display, window);
         XCloseDisplay(display);
@@ -78,6 +213,7 @@ static const struct {
         int xkeysym;
         int keyKind;
 } keymap[] = {
+        { XK_Return, KEY_ENTER },
         { XK_Escape, KEY_ESCAPE },
         { XK_space, KEY_SPACE },
         { XK_BackSpace, KEY_BACKSPACE },
@@ -85,6 +221,9 @@ static const struct {
         { XK_Right, KEY_RIGHT },
         { XK_Up, KEY_UP },
         { XK_Down, KEY_DOWN },
+        { XK_F1, KEY_F1 },
+        { XK_F2, KEY_F2 },
+        { XK_F3, KEY_F3 },
 };
 
 static int xbutton_to_mousebuttonKind(int xbutton)
@@ -117,6 +256,7 @@ static void handle_x11_button_press_or_release(XButtonEvent *xbutton, int mouseb
 
 void fetch_all_pending_events(void)
 {
+        TRACE_SCOPE("fetch_all_pending_events");
         while (XPending(display)) {
                 XEvent event;
                 XNextEvent(display, &event);
@@ -136,6 +276,10 @@ void fetch_all_pending_events(void)
                         int y = motion->y;
                         send_mousemove_event(x, y);
                 }
+                else if (event.type == ConfigureNotify) {
+                        XConfigureEvent *configure = &event.xconfigure;
+                        send_windowresize_event(configure->width, configure->height);
+                }
                 else if (event.type == ButtonPress) {
                         XButtonEvent *button = &event.xbutton;
                         handle_x11_button_press_or_release(button, MOUSEBUTTONEVENT_PRESS);
@@ -147,6 +291,16 @@ void fetch_all_pending_events(void)
         }
 }
 
+int query_mouse_position(int *x, int *y)
+{
+        TRACE_SCOPE("query_mouse_position");
+        Window root, child;
+        int rootX, rootY;
+        unsigned int mask;
+        // False if the pointer is on another screen
+        return XQueryPointer(display, window, &root, &child, &rootX, &rootY, x, y, &mask);
+}
+
 void *load_opengl_pointer(const char *name)
 {
         return glXGetProcAddress((const GLubyte *) name);
@@ -154,5 +308,15 @@ void *load_opengl_pointer(const char *name)
 
 void swap_buffers(void)
 {
+        TRACE_SCOPE("swap_buffers");
         glXSwapBuffers(display, window);
 }
+
+int get_back_buffer_age(void)
+{
+        if (!haveBufferAge)
+                return 0;
+        unsigned int age = 0;
+        glXQueryDrawable(display, window, GLX_BACK_BUFFER_AGE_EXT, &age);
+        return (int) age;
+}
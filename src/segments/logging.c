@@ -1,11 +1,397 @@
+#include <segments/clock.h>
+#include <segments/defs.h>
 #include <segments/logging.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+
+#define THREAD_LOCAL __declspec(thread)
+
+static SRWLOCK logLock = SRWLOCK_INIT;
+
+static void lock_log(void) { AcquireSRWLockExclusive(&logLock); }
+static void unlock_log(void) { ReleaseSRWLockExclusive(&logLock); }
+static void sleep_ms(int ms) { Sleep(ms); }
+
+static uint32_t load_acquire(volatile uint32_t *p)
+{
+        uint32_t value = *p;
+        MemoryBarrier();
+        return value;
+}
+
+static void store_release(volatile uint32_t *p, uint32_t value)
+{
+        MemoryBarrier();
+        *p = value;
+}
+
+static DWORD WINAPI writer_thread(LPVOID arg);
+
+static int start_writer_thread(void)
+{
+        HANDLE thread = CreateThread(NULL, 0, writer_thread, NULL, 0, NULL);
+        if (thread == NULL)
+                return 0;
+        CloseHandle(thread);
+        return 1;
+}
+#else
+#include <pthread.h>
+#include <time.h>
+
+#define THREAD_LOCAL __thread
+
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock_log(void) { pthread_mutex_lock(&logMutex); }
+static void unlock_log(void) { pthread_mutex_unlock(&logMutex); }
+
+static void sleep_ms(int ms)
+{
+        struct timespec ts = { 0, ms * 1000000L };
+        nanosleep(&ts, NULL);
+}
+
+static uint32_t load_acquire(volatile uint32_t *p)
+{
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(volatile uint32_t *p, uint32_t value)
+{
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static void *writer_thread(void *arg);
+
+static int start_writer_thread(void)
+{
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, writer_thread, NULL))
+                return 0;
+        pthread_detach(thread);
+        return 1;
+}
+#endif
+
+enum {
+        LOGRING_SIZE = 1 << 16,  // bytes, a power of 2
+        MAX_LOG_MESSAGE_LENGTH = 4096,
+        MAX_MESSAGES_PER_SECOND = 10,  // per call site
+        WRITER_INTERVAL_MS = 5,
+        LOGLEVEL_PADDING = 0xFF,  // the rest of the ring up to its end is unused
+};
+
+/* One ring per thread that logs. Only that thread writes records and moves
+the head, only the writer reads records and moves the tail. head and tail
+count bytes since the start and wrap around at 2^32. A record is a struct
+LogfileRecord followed by the text, and padded to a multiple of 16 bytes, so
+there is always room for a header before the end of the ring. */
+struct LogRing {
+        struct LogRing *next;
+        uint32_t threadIndex;
+        volatile uint32_t head;
+        volatile uint32_t tail;
+        volatile uint32_t numDropped;
+        uint32_t numDroppedReported;  // by the writer
+        unsigned char data[LOGRING_SIZE];
+};
+
+static THREAD_LOCAL struct LogRing *threadRing;
+static struct LogRing *logRings;  // all of them, protected by the lock
+static int numLogRings;
+static int writerIsRunning;
+
+static int minLoglevel[NUM_LOGCATEGORY_KINDS] = {
+        [LOGCATEGORY_GENERAL] = LOGLEVEL_INFO,
+        [LOGCATEGORY_GFX] = LOGLEVEL_INFO,
+        [LOGCATEGORY_GL] = LOGLEVEL_INFO,
+        [LOGCATEGORY_SHADERS] = LOGLEVEL_INFO,
+        [LOGCATEGORY_WINDOW] = LOGLEVEL_INFO,
+};
+
+static FILE *logFile;
+static int logIsBinary;
+
+static const char *const loglevelNames[NUM_LOGLEVEL_KINDS] = {
+        [LOGLEVEL_DEBUG] = "debug",
+        [LOGLEVEL_INFO] = "info",
+        [LOGLEVEL_WARNING] = "warning",
+        [LOGLEVEL_ERROR] = "error",
+};
+
+static const char *const loglevelPrefix[NUM_LOGLEVEL_KINDS] = {
+        [LOGLEVEL_DEBUG] = "Debug: ",
+        [LOGLEVEL_INFO] = "",
+        [LOGLEVEL_WARNING] = "Warning: ",
+        [LOGLEVEL_ERROR] = "Error: ",
+};
+
+static const char *const logcategoryNames[NUM_LOGCATEGORY_KINDS] = {
+        [LOGCATEGORY_GENERAL] = "general",
+        [LOGCATEGORY_GFX] = "gfx",
+        [LOGCATEGORY_GL] = "gl",
+        [LOGCATEGORY_SHADERS] = "shaders",
+        [LOGCATEGORY_WINDOW] = "window",
+};
+
+static uint32_t get_record_size(int length)
+{
+        return (uint32_t) (sizeof (struct LogfileRecord) + length + 15) & ~15u;
+}
+
+static struct LogRing *get_thread_ring(void)
+{
+        if (threadRing != NULL)
+                return threadRing;
+        // not with ALLOC_MEMORY(), which logs when it fails
+        struct LogRing *ring = calloc(1, sizeof *ring);
+        if (ring == NULL)
+                return NULL;
+        lock_log();
+        ring->threadIndex = numLogRings++;
+        ring->next = logRings;
+        logRings = ring;
+        unlock_log();
+        threadRing = ring;
+        return ring;
+}
+
+static int push_record(struct LogRing *ring, const struct LogfileRecord *record, const char *text)
+{
+        uint32_t size = get_record_size(record->length);
+        uint32_t head = ring->head;
+        uint32_t tail = load_acquire(&ring->tail);
+        uint32_t pos = head & (LOGRING_SIZE - 1);
+        uint32_t untilEnd = LOGRING_SIZE - pos;
+        uint32_t needed = untilEnd < size ? untilEnd + size : size;
+        if (LOGRING_SIZE - (head - tail) < needed) {
+                store_release(&ring->numDropped, ring->numDropped + 1);
+                return 0;
+        }
+        if (untilEnd < size) {
+                struct LogfileRecord padding = { 0 };
+                padding.loglevelKind = LOGLEVEL_PADDING;
+                memcpy(ring->data + pos, &padding, sizeof padding);
+                head += untilEnd;
+                pos = 0;
+        }
+        memcpy(ring->data + pos, record, sizeof *record);
+        memcpy(ring->data + pos + sizeof *record, text, record->length);
+        store_release(&ring->head, head + size);
+        return 1;
+}
+
+/* Returns the next record of the ring, or NULL if there is none. Called by
+the writer, with the lock. */
+static const struct LogfileRecord *peek_record(struct LogRing *ring)
+{
+        uint32_t head = load_acquire(&ring->head);
+        uint32_t tail = ring->tail;
+        if (tail == head)
+                return NULL;
+        uint32_t pos = tail & (LOGRING_SIZE - 1);
+        const struct LogfileRecord *record = (const struct LogfileRecord *) (ring->data + pos);
+        if (record->loglevelKind != LOGLEVEL_PADDING)
+                return record;
+        tail += LOGRING_SIZE - pos;
+        store_release(&ring->tail, tail);
+        if (tail == head)
+                return NULL;
+        return (const struct LogfileRecord *) ring->data;
+}
+
+static void write_record(const struct LogfileRecord *record, const char *text)
+{
+        FILE *f = logFile ? logFile : stderr;
+        if (logIsBinary) {
+                fwrite(record, sizeof *record, 1, f);
+                fwrite(text, 1, record->length, f);
+        }
+        else
+                fprintf(f, "%s%.*s\n", loglevelPrefix[record->loglevelKind], (int) record->length, text);
+}
+
+static int write_dropped_messages(struct LogRing *ring)
+{
+        uint32_t numDropped = load_acquire(&ring->numDropped);
+        if (numDropped == ring->numDroppedReported)
+                return 0;
+        char text[64];
+        struct LogfileRecord record = { get_time_ns(), LOGLEVEL_WARNING, LOGCATEGORY_GENERAL, 0, ring->threadIndex };
+        record.length = (uint16_t) snprintf(text, sizeof text, "%u log messages dropped",
+                                            numDropped - ring->numDroppedReported);
+        write_record(&record, text);
+        ring->numDroppedReported = numDropped;
+        return 1;
+}
+
+/* Write the records of all rings, oldest first. Called with the lock. */
+static void drain_rings(void)
+{
+        int haveWritten = 0;
+        for (;;) {
+                struct LogRing *oldestRing = NULL;
+                const struct LogfileRecord *oldest = NULL;
+                for (struct LogRing *ring = logRings; ring != NULL; ring = ring->next) {
+                        const struct LogfileRecord *record = peek_record(ring);
+                        if (record != NULL && (oldest == NULL || record->timeNs < oldest->timeNs)) {
+                                oldest = record;
+                                oldestRing = ring;
+                        }
+                }
+                if (oldest == NULL)
+                        break;
+                write_record(oldest, (const char *) (oldest + 1));
+                store_release(&oldestRing->tail, oldestRing->tail + get_record_size(oldest->length));
+                haveWritten = 1;
+        }
+        for (struct LogRing *ring = logRings; ring != NULL; ring = ring->next)
+                haveWritten |= write_dropped_messages(ring);
+        if (haveWritten)
+                fflush(logFile ? logFile : stderr);
+}
+
+void flush_log(void)
+{
+        lock_log();
+        drain_rings();
+        unlock_log();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writer_thread(LPVOID arg)
+#else
+static void *writer_thread(void *arg)
+#endif
+{
+        (void) arg;
+        for (;;) {
+                flush_log();
+                sleep_ms(WRITER_INTERVAL_MS);
+        }
+        return 0;
+}
+
+static int find_name(const char *const *names, int numNames, const char *name, size_t length)
+{
+        for (int i = 0; i < numNames; i++)
+                if (strlen(names[i]) == length && !strncmp(names[i], name, length))
+                        return i;
+        return -1;
+}
+
+static void parse_log_levels(const char *spec)
+{
+        while (*spec) {
+                size_t length = strcspn(spec, ",");
+                const char *equals = memchr(spec, '=', length);
+                const char *levelName = equals ? equals + 1 : spec;
+                size_t levelLength = length - (levelName - spec);
+                int level = find_name(loglevelNames, NUM_LOGLEVEL_KINDS, levelName, levelLength);
+                int category = equals ? find_name(logcategoryNames, NUM_LOGCATEGORY_KINDS, spec, equals - spec) : -1;
+                if (level == -1 || (equals && category == -1))
+                        LOG_WARNING(LOGCATEGORY_GENERAL, "Bad SEGMENTS_LOG_LEVEL entry '%.*s'", (int) length, spec);
+                else if (category != -1)
+                        minLoglevel[category] = level;
+                else
+                        for (int i = 0; i < NUM_LOGCATEGORY_KINDS; i++)
+                                minLoglevel[i] = level;
+                spec += length;
+                if (*spec == ',')
+                        spec++;
+        }
+}
+
+void start_logging(void)
+{
+        const char *env = getenv("SEGMENTS_LOG_LEVEL");
+        if (env != NULL)
+                parse_log_levels(env);
+        env = getenv("SEGMENTS_LOG_FORMAT");
+        logIsBinary = env != NULL && !strcmp(env, "binary");
+        env = getenv("SEGMENTS_LOG_FILE");
+        if (env != NULL) {
+                logFile = fopen(env, logIsBinary ? "wb" : "w");
+                if (logFile == NULL)
+                        LOG_WARNING(LOGCATEGORY_GENERAL, "Failed to open log file '%s', logging to stderr", env);
+        }
+        if (logFile == NULL)
+                logIsBinary = 0;  // not on the terminal
+        if (logIsBinary)
+                fwrite("SEGLOG1\n", 1, 8, logFile);
+        atexit(flush_log);
+        writerIsRunning = start_writer_thread();
+        if (!writerIsRunning)
+                LOG_WARNING(LOGCATEGORY_GENERAL, "Failed to start the log writer thread, logging directly");
+}
+
+int is_logged(int loglevelKind, int logcategoryKind)
+{
+        return loglevelKind >= minLoglevel[logcategoryKind];
+}
+
+void log_fv(struct LogSite *site, int loglevelKind, int logcategoryKind, const char *fmt, va_list ap)
+{
+        if (!is_logged(loglevelKind, logcategoryKind))
+                return;
+        uint64_t now = get_time_ns();
+        int numSuppressed = 0;
+        if (site != NULL) {
+                // races between threads only make the limit inexact
+                if (now - site->intervalStartNs >= 1000000000) {
+                        site->intervalStartNs = now;
+                        site->numInInterval = 0;
+                }
+                if (site->numInInterval == MAX_MESSAGES_PER_SECOND) {
+                        site->numSuppressed++;
+                        return;
+                }
+                site->numInInterval++;
+                numSuppressed = site->numSuppressed;
+                site->numSuppressed = 0;
+        }
+        char text[MAX_LOG_MESSAGE_LENGTH];
+        int length = vsnprintf(text, sizeof text, fmt, ap);
+        if (length < 0)
+                length = 0;
+        if (length >= (int) sizeof text)
+                length = sizeof text - 1;
+        if (numSuppressed > 0)
+                length += snprintf(text + length, sizeof text - length,
+                                   " (%d similar messages suppressed)", numSuppressed);
+        if (length >= (int) sizeof text)
+                length = sizeof text - 1;
+        struct LogfileRecord record = { now, loglevelKind, logcategoryKind, length, 0 };
+        struct LogRing *ring = get_thread_ring();
+        if (ring == NULL) {
+                // out of memory, better late than never
+                lock_log();
+                write_record(&record, text);
+                unlock_log();
+                return;
+        }
+        record.threadIndex = ring->threadIndex;
+        push_record(ring, &record, text);
+        if (!writerIsRunning)
+                flush_log();
+}
+
+void log_f(struct LogSite *site, int loglevelKind, int logcategoryKind, const char *fmt, ...)
+{
+        va_list ap;
+        va_start(ap, fmt);
+        log_fv(site, loglevelKind, logcategoryKind, fmt, ap);
+        va_end(ap);
+}
 
 void message_fv(const char *fmt, va_list ap)
 {
-        vfprintf(stderr, fmt, ap);
-        fprintf(stderr, "\n");
+        log_fv(NULL, LOGLEVEL_INFO, LOGCATEGORY_GENERAL, fmt, ap);
 }
 
 void message_f(const char *fmt, ...)
@@ -18,9 +404,21 @@ void message_f(const char *fmt, ...)
 
 void fatal_f(const char *fmt, ...)
 {
+        char text[MAX_LOG_MESSAGE_LENGTH];
         va_list ap;
         va_start(ap, fmt);
-        message_fv(fmt, ap);
+        int length = vsnprintf(text, sizeof text, fmt, ap);
         va_end(ap);
+        if (length < 0)
+                length = 0;
+        if (length >= (int) sizeof text)
+                length = sizeof text - 1;
+        // not through the ring, which might be full
+        struct LogfileRecord record = { get_time_ns(), LOGLEVEL_ERROR, LOGCATEGORY_GENERAL, length, 0 };
+        lock_log();
+        drain_rings();
+        write_record(&record, text);
+        fflush(logFile ? logFile : stderr);
+        unlock_log();
         abort();
 }
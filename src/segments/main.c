@@ -1,8 +1,12 @@
 #include <segments/opengl.h>
 #include <segments/gfx.h>
+#include <segments/logging.h>
+#include <segments/trace.h>
 
 int main(void)
 {
+        start_logging();
+        START_TRACING("segments-trace.json");
         create_opengl_context();
         setup_opengl();
         do_gfx();
@@ -2,8 +2,11 @@
 #include <segments/memory.h>
 #include <stdlib.h>
 
+static uint64_t numReallocs;
+
 void realloc_memory(void **ptr, int numElems, int elemSize)
 {
+        numReallocs++;
         int numBytes = numElems * elemSize + 16;
         void *p;
         if (*ptr)
@@ -11,7 +14,7 @@ void realloc_memory(void **ptr, int numElems, int elemSize)
         else
                 p = malloc(numBytes);
         if (p == NULL)
-                fatal_f("OOM!\n");
+                fatal_f("OOM!");
         *(int *) p = numElems;
         *ptr = (char *) p + 16;
 }
@@ -24,6 +27,12 @@ void alloc_memory(void **ptr, int numElems, int elemSize)
 
 void free_memory(void **ptr)
 {
-        free(*ptr);
+        if (*ptr)
+                free((char *) *ptr - 16);
         *ptr = NULL;
 }
+
+uint64_t get_number_of_reallocs(void)
+{
+        return numReallocs;
+}
@@ -0,0 +1,287 @@
+#include <segments/defs.h>
+#include <segments/logging.h>
+#include <segments/memory.h>
+#include <segments/opengl.h>
+#include <segments/programcache.h>
+#include <segments/trace.h>
+#include <shaders.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#define make_directory(path) mkdir((path), 0700)
+#endif
+
+enum {
+        PROGRAMCACHE_MAGIC = 0x4d505353,  // "SSPM"
+        PROGRAMCACHE_VERSION = 2,
+};
+
+struct ProgramcacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t numPrograms;
+        uint32_t unused;
+};
+
+// one for each program, binaryLength is 0 for variants that weren't compiled
+struct ProgramcacheEntry {
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+};
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+        const unsigned char *p = data;
+        for (size_t i = 0; i < size; i++) {
+                hash ^= p[i];
+                hash *= 1099511628211u;
+        }
+        return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char *string)
+{
+        return hash_bytes(hash, string, strlen(string) + 1);
+}
+
+static uint64_t compute_cache_key(void)
+{
+        uint64_t hash = 14695981039346656037u;
+        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
+                hash = hash_string(hash, smShaderInfo[i].name);
+                hash = hash_bytes(hash, smShaderInfo[i].shaderSource, smShaderInfo[i].shaderSourceSize);
+                hash = hash_bytes(hash, &smShaderInfo[i].shadertypeKind, sizeof smShaderInfo[i].shadertypeKind);
+        }
+        for (int i = 0; i < numLinkInfos; i++)
+                hash = hash_bytes(hash, &smLinkInfo[i], sizeof smLinkInfo[i]);
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                hash = hash_string(hash, smProgramInfo[i].name);
+                hash = hash_bytes(hash, &smProgramInfo[i].baseProgramIndex, sizeof smProgramInfo[i].baseProgramIndex);
+                hash = hash_string(hash, smProgramInfo[i].defines);
+        }
+        // the attribute locations are bound before linking
+        for (int i = 0; i < NUM_ATTRIBUTE_KINDS; i++) {
+                hash = hash_string(hash, smAttributeInfo[i].name);
+                hash = hash_bytes(hash, &smAttributeInfo[i].location, sizeof smAttributeInfo[i].location);
+        }
+        hash = hash_string(hash, (const char *) glGetString(GL_VENDOR));
+        hash = hash_string(hash, (const char *) glGetString(GL_RENDERER));
+        hash = hash_string(hash, (const char *) glGetString(GL_VERSION));
+        return hash;
+}
+
+static int is_cache_supported(void)
+{
+        if (getenv("SEGMENTS_NO_PROGRAM_CACHE"))
+                return 0;
+        if (!have_gl_extension("GL_ARB_get_program_binary"))
+                return 0;
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        return numFormats > 0;
+}
+
+static int get_cache_filepath(char *buf, int size, int createDirectory)
+{
+        const char *xdgCacheHome = getenv("XDG_CACHE_HOME");
+        const char *home = getenv("HOME");
+#ifdef _WIN32
+        const char *localAppData = getenv("LOCALAPPDATA");
+#endif
+        char dirpath[512];
+        int r;
+        if (xdgCacheHome && xdgCacheHome[0])
+                r = snprintf(dirpath, sizeof dirpath, "%s/segments", xdgCacheHome);
+#ifdef _WIN32
+        else if (localAppData)
+                r = snprintf(dirpath, sizeof dirpath, "%s/segments", localAppData);
+#endif
+        else if (home)
+                r = snprintf(dirpath, sizeof dirpath, "%s/.cache/segments", home);
+        else
+                return 0;
+        if (r < 0 || r >= sizeof dirpath)
+                return 0;
+        if (createDirectory) {
+                // create the parent too, in case ~/.cache doesn't exist yet
+                char *slash = strrchr(dirpath, '/');
+                *slash = '\0';
+                make_directory(dirpath);
+                *slash = '/';
+                if (make_directory(dirpath) == -1 && errno != EEXIST) {
+                        LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to create directory '%s': %s",
+                                                         dirpath, strerror(errno));
+                        return 0;
+                }
+        }
+        r = snprintf(buf, size, "%s/programs.bin", dirpath);
+        return 0 <= r && r < size;
+}
+
+static int read_file(const char *filepath, char **outData, long *outSize)
+{
+        FILE *f = fopen(filepath, "rb");
+        if (f == NULL)
+                return 0;
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        char *data = NULL;
+        int ok = size > 0;
+        if (ok) {
+                ALLOC_MEMORY(&data, size);
+                ok = fread(data, 1, size, f) == (size_t) size;
+        }
+        fclose(f);
+        if (!ok) {
+                FREE_MEMORY(&data);
+                return 0;
+        }
+        *outData = data;
+        *outSize = size;
+        return 1;
+}
+
+static void delete_programs(void)
+{
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                if (gfxProgram[i] != 0)
+                        glDeleteProgram(gfxProgram[i]);
+                gfxProgram[i] = 0;
+        }
+}
+
+int load_programs_from_cache(void)
+{
+        TRACE_SCOPE("load_programs_from_cache");
+        if (!is_cache_supported())
+                return 0;
+        char filepath[600];
+        if (!get_cache_filepath(filepath, sizeof filepath, 0))
+                return 0;
+        char *data;
+        long size;
+        if (!read_file(filepath, &data, &size))
+                return 0;
+
+        int ok = 0;
+        long pos = sizeof (struct ProgramcacheHeader);
+        struct ProgramcacheHeader header;
+        if (size < pos)
+                goto out;
+        memcpy(&header, data, sizeof header);
+        if (header.magic != PROGRAMCACHE_MAGIC
+            || header.version != PROGRAMCACHE_VERSION
+            || header.key != compute_cache_key()
+            || header.numPrograms != NUM_PROGRAM_KINDS)
+                goto out;
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                int isVariant = smProgramInfo[i].baseProgramIndex != i;
+                struct ProgramcacheEntry entry;
+                if (size - pos < (long) sizeof entry)
+                        goto out;
+                memcpy(&entry, data + pos, sizeof entry);
+                pos += sizeof entry;
+                if (size - pos < (long) entry.binaryLength)
+                        goto out;
+                if (entry.binaryLength == 0) {
+                        if (isVariant)
+                                continue;
+                        goto out;
+                }
+                GLuint program = glCreateProgram();
+                if (program == 0)
+                        goto out;
+                gfxProgram[i] = program;
+                glProgramBinary(program, entry.binaryFormat, data + pos, entry.binaryLength);
+                pos += entry.binaryLength;
+                // the driver may reject binaries, for example after an update
+                GLint linkStatus;
+                glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+                if (linkStatus != GL_TRUE) {
+                        if (!isVariant)
+                                goto out;
+                        // the variant will be compiled when it is needed
+                        glDeleteProgram(program);
+                        gfxProgram[i] = 0;
+                }
+        }
+        ok = 1;
+out:
+        FREE_MEMORY(&data);
+        // clear any errors from glProgramBinary() with an invalid format
+        while (glGetError() != GL_NO_ERROR)
+                ;
+        if (ok)
+                return 1;
+        delete_programs();
+        LOG_INFO(LOGCATEGORY_SHADERS, "Program cache '%s' is stale, recompiling", filepath);
+        return 0;
+}
+
+void store_programs_in_cache(const int *programIsReady)
+{
+        TRACE_SCOPE("store_programs_in_cache");
+        if (!is_cache_supported())
+                return;
+        char filepath[600];
+        char tmpFilepath[610];
+        if (!get_cache_filepath(filepath, sizeof filepath, 1))
+                return;
+        snprintf(tmpFilepath, sizeof tmpFilepath, "%s.tmp", filepath);
+
+        FILE *f = fopen(tmpFilepath, "wb");
+        if (f == NULL) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to open '%s' for writing: %s",
+                                                 tmpFilepath, strerror(errno));
+                return;
+        }
+        struct ProgramcacheHeader header = {
+                .magic = PROGRAMCACHE_MAGIC,
+                .version = PROGRAMCACHE_VERSION,
+                .key = compute_cache_key(),
+                .numPrograms = NUM_PROGRAM_KINDS,
+        };
+        fwrite(&header, sizeof header, 1, f);
+        char *binary = NULL;
+        for (int i = 0; i < NUM_PROGRAM_KINDS; i++) {
+                GLint length = 0;
+                GLenum binaryFormat = 0;
+                if (programIsReady[i])
+                        glGetProgramiv(gfxProgram[i], GL_PROGRAM_BINARY_LENGTH, &length);
+                if (length > 0) {
+                        REALLOC_MEMORY(&binary, length);
+                        glGetProgramBinary(gfxProgram[i], length, &length, &binaryFormat, binary);
+                }
+                struct ProgramcacheEntry entry = { binaryFormat, length };
+                fwrite(&entry, sizeof entry, 1, f);
+                fwrite(binary, 1, length, f);
+        }
+        FREE_MEMORY(&binary);
+        fflush(f);
+        int failed = ferror(f);
+        fclose(f);
+        if (failed) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "I/O error while writing '%s'", tmpFilepath);
+                remove(tmpFilepath);
+                return;
+        }
+#ifdef _WIN32
+        remove(filepath);  // rename() doesn't replace existing files on Windows
+#endif
+        if (rename(tmpFilepath, filepath) != 0)
+                LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to rename '%s' to '%s': %s",
+                                                 tmpFilepath, filepath, strerror(errno));
+}
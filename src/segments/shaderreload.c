@@ -0,0 +1,203 @@
+#include <segments/defs.h>
+#include <segments/logging.h>
+#include <segments/memory.h>
+#include <segments/shaderreload.h>
+#include <shaders.h>
+
+#if defined SEGMENTS_SHADER_HOT_RELOAD && defined __linux__
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static int inotifyFd = -1;
+static char *shaderSource[NUM_SHADER_KINDS];  // as last read from the file
+static int shaderSourceSize[NUM_SHADER_KINDS];
+static int shaderIsReloaded[NUM_SHADER_KINDS];
+
+static void append_text(char **buf, int *size, const char *text, int length)
+{
+        REALLOC_MEMORY(buf, *size + length + 1);
+        memcpy(*buf + *size, text, length);
+        *size += length;
+        (*buf)[*size] = '\0';
+}
+
+/* The files that are being read, to find #include cycles. */
+struct IncludeFrame {
+        const char *filepath;
+        const struct IncludeFrame *parent;
+};
+
+/* Do to the file what glsl-processor does when the shaders are processed:
+the #include "file" lines are replaced by the contents of the file. Like the
+file IDs in process-shaders, the paths are relative to the source tree. The
+#version line of the shader file itself is moved to *version, those of
+included files are dropped.
+
+glsl-processor itself is not linked in, because it reports every problem
+with gp_fatal_f(), which ends the process. A typo in the shader that is being
+edited would end the program instead of leaving the old program in use. */
+static int append_preprocessed_file(char **buf, int *size, char **version, int *versionSize,
+                                    const char *filepath, const struct IncludeFrame *parent)
+{
+        for (const struct IncludeFrame *frame = parent; frame != NULL; frame = frame->parent) {
+                if (!strcmp(frame->filepath, filepath)) {
+                        LOG_WARNING(LOGCATEGORY_SHADERS, "'%s' includes itself", filepath);
+                        return 0;
+                }
+        }
+        struct IncludeFrame frame = { filepath, parent };
+        FILE *f = fopen(filepath, "rb");
+        if (f == NULL) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to open '%s': %s", filepath, strerror(errno));
+                return 0;
+        }
+        int ok = 1;
+        char line[1024];
+        while (ok && fgets(line, sizeof line, f)) {
+                char includePath[512];
+                if (!strncmp(line, "#version", 8)) {
+                        if (parent == NULL && *versionSize == 0)
+                                append_text(version, versionSize, line, (int) strlen(line));
+                        // the line stays, empty, like in the embedded sources
+                        append_text(buf, size, "\n", 1);
+                }
+                else if (sscanf(line, "#include \"%511[^\"]\"", includePath) == 1)
+                        ok = append_preprocessed_file(buf, size, version, versionSize, includePath, &frame);
+                else
+                        append_text(buf, size, line, (int) strlen(line));
+        }
+        if (ferror(f)) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "I/O error while reading '%s'", filepath);
+                ok = 0;
+        }
+        fclose(f);
+        return ok;
+}
+
+/* The #version line comes first, the variant #define's are inserted after
+it (see create_program() in gfx.c). */
+static int read_shader_source(int shaderIndex, char **outSource, int *outSize)
+{
+        char *version = NULL;
+        int versionSize = 0;
+        char *body = NULL;
+        int bodySize = 0;
+        int ok = append_preprocessed_file(&body, &bodySize, &version, &versionSize,
+                                          smShaderInfo[shaderIndex].filepath, NULL);
+        if (ok && versionSize == 0) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "No #version line in '%s'", smShaderInfo[shaderIndex].filepath);
+                ok = 0;
+        }
+        if (ok) {
+                if (version[versionSize - 1] != '\n')
+                        append_text(&version, &versionSize, "\n", 1);
+                append_text(&version, &versionSize, body, bodySize);
+        }
+        FREE_MEMORY(&body);
+        if (!ok) {
+                FREE_MEMORY(&version);
+                return 0;
+        }
+        *outSource = version;
+        *outSize = versionSize;
+        return 1;
+}
+
+int start_watching_shader_files(void)
+{
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd == -1) {
+                LOG_WARNING(LOGCATEGORY_SHADERS, "inotify_init1() failed: %s", strerror(errno));
+                return 0;
+        }
+        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
+                if (!read_shader_source(i, &shaderSource[i], &shaderSourceSize[i])) {
+                        LOG_WARNING(LOGCATEGORY_SHADERS, "Not watching shader files, run from the source tree");
+                        close(inotifyFd);
+                        inotifyFd = -1;
+                        return 0;
+                }
+                // editors often replace files instead of writing them, so watch the directory
+                char dirpath[512];
+                snprintf(dirpath, sizeof dirpath, "%s", smShaderInfo[i].filepath);
+                char *slash = strrchr(dirpath, '/');
+                if (slash)
+                        *slash = '\0';
+                else
+                        snprintf(dirpath, sizeof dirpath, ".");
+                // watching the same directory again returns the same watch
+                if (inotify_add_watch(inotifyFd, dirpath, IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+                        LOG_WARNING(LOGCATEGORY_SHADERS, "Failed to watch '%s': %s", dirpath, strerror(errno));
+        }
+        LOG_INFO(LOGCATEGORY_SHADERS, "Watching shader files for changes");
+        return 1;
+}
+
+int check_shader_files(int *changedShaders)
+{
+        if (inotifyFd == -1)
+                return 0;
+        int haveEvents = 0;
+        for (;;) {
+                char events[4096];  // the events themselves don't matter
+                ssize_t r = read(inotifyFd, events, sizeof events);
+                if (r <= 0)
+                        break;
+                haveEvents = 1;
+        }
+        if (!haveEvents)
+                return 0;
+        // any shader might include the file that changed, so check all of them
+        int haveChanges = 0;
+        for (int i = 0; i < NUM_SHADER_KINDS; i++) {
+                char *source;
+                int size;
+                if (!read_shader_source(i, &source, &size))
+                        continue;
+                if (size == shaderSourceSize[i] && !memcmp(source, shaderSource[i], size)) {
+                        FREE_MEMORY(&source);
+                        continue;
+                }
+                FREE_MEMORY(&shaderSource[i]);
+                shaderSource[i] = source;
+                shaderSourceSize[i] = size;
+                shaderIsReloaded[i] = 1;
+                changedShaders[i] = 1;
+                haveChanges = 1;
+        }
+        return haveChanges;
+}
+
+const char *get_reloaded_shader_source(int shaderIndex, int *outSize)
+{
+        if (!shaderIsReloaded[shaderIndex])
+                return NULL;
+        *outSize = shaderSourceSize[shaderIndex];
+        return shaderSource[shaderIndex];
+}
+
+#else
+
+int start_watching_shader_files(void)
+{
+        return 0;
+}
+
+int check_shader_files(int *changedShaders)
+{
+        (void) changedShaders;
+        return 0;
+}
+
+const char *get_reloaded_shader_source(int shaderIndex, int *outSize)
+{
+        (void) shaderIndex;
+        (void) outSize;
+        return NULL;
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include <segments/trace.h>
+
+#ifdef SEGMENTS_TRACE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This file is also built into process-shaders, so it doesn't use the rest
+of segments (other than the clock). */
+
+enum {
+        EVENTS_PER_CHUNK = 4096,
+        MAX_CHUNKS_PER_THREAD = 256,  // about 24 MB of events per thread
+};
+
+struct TraceEvent {
+        const char *name;
+        uint64_t startNs;
+        uint64_t endNs;
+};
+
+struct TraceChunk {
+        struct TraceChunk *next;
+        uint32_t numEvents;  // written by the owning thread only
+        struct TraceEvent events[EVENTS_PER_CHUNK];
+};
+
+/* The events of one thread. Only the thread itself appends to its buffer,
+without locking. The list of buffers is protected by traceMutex. */
+struct TraceBuffer {
+        struct TraceBuffer *next;
+        int threadIndex;
+        struct TraceChunk *firstChunk;
+        struct TraceChunk *lastChunk;
+        int numChunks;
+        uint64_t numDropped;
+};
+
+static __thread struct TraceBuffer *threadBuffer;
+static struct TraceBuffer *traceBuffers;
+static int numTraceBuffers;
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *traceFilepath;
+static uint64_t traceStartNs;
+
+static struct TraceBuffer *get_thread_buffer(void)
+{
+        if (threadBuffer != NULL)
+                return threadBuffer;
+        struct TraceBuffer *buffer = calloc(1, sizeof *buffer);
+        if (buffer == NULL)
+                return NULL;
+        pthread_mutex_lock(&traceMutex);
+        buffer->threadIndex = numTraceBuffers++;
+        buffer->next = traceBuffers;
+        traceBuffers = buffer;
+        pthread_mutex_unlock(&traceMutex);
+        threadBuffer = buffer;
+        return buffer;
+}
+
+void end_trace_scope(struct TraceScope *scope)
+{
+        uint64_t endNs = get_time_ns();
+        struct TraceBuffer *buffer = get_thread_buffer();
+        if (buffer == NULL)
+                return;
+        struct TraceChunk *chunk = buffer->lastChunk;
+        if (chunk == NULL || chunk->numEvents == EVENTS_PER_CHUNK) {
+                if (buffer->numChunks == MAX_CHUNKS_PER_THREAD
+                    || (chunk = calloc(1, sizeof *chunk)) == NULL) {
+                        buffer->numDropped++;
+                        return;
+                }
+                // the chunk must be complete before the dump can see it
+                pthread_mutex_lock(&traceMutex);
+                if (buffer->lastChunk)
+                        buffer->lastChunk->next = chunk;
+                else
+                        buffer->firstChunk = chunk;
+                buffer->lastChunk = chunk;
+                buffer->numChunks++;
+                pthread_mutex_unlock(&traceMutex);
+        }
+        struct TraceEvent *event = &chunk->events[chunk->numEvents];
+        event->name = scope->name;
+        event->startNs = scope->startNs;
+        event->endNs = endNs;
+        __atomic_store_n(&chunk->numEvents, chunk->numEvents + 1, __ATOMIC_RELEASE);
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+        fputc('"', f);
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\')
+                        fputc('\\', f);
+                if ((unsigned char) *s >= 0x20)
+                        fputc(*s, f);
+        }
+        fputc('"', f);
+}
+
+/* Complete events ("ph": "X") with times in microseconds since
+start_tracing(). Nested scopes of a thread show up as a stack. */
+static void write_trace(void)
+{
+        FILE *f = fopen(traceFilepath, "w");
+        if (f == NULL) {
+                fprintf(stderr, "Warning: Failed to open trace file '%s'\n", traceFilepath);
+                return;
+        }
+        pthread_mutex_lock(&traceMutex);
+        uint64_t numDropped = 0;
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (struct TraceBuffer *buffer = traceBuffers; buffer != NULL; buffer = buffer->next) {
+                fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                        "\"args\":{\"name\":\"thread %d\"}}",
+                        buffer == traceBuffers ? "" : ",\n", buffer->threadIndex, buffer->threadIndex);
+                for (struct TraceChunk *chunk = buffer->firstChunk; chunk != NULL; chunk = chunk->next) {
+                        uint32_t n = __atomic_load_n(&chunk->numEvents, __ATOMIC_ACQUIRE);
+                        for (uint32_t i = 0; i < n; i++) {
+                                const struct TraceEvent *event = &chunk->events[i];
+                                fprintf(f, ",\n{\"name\":");
+                                write_json_string(f, event->name);
+                                fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                        buffer->threadIndex,
+                                        (double) (event->startNs - traceStartNs) / 1e3,
+                                        (double) (event->endNs - event->startNs) / 1e3);
+                        }
+                }
+                numDropped += buffer->numDropped;
+        }
+        pthread_mutex_unlock(&traceMutex);
+        fprintf(f, "\n]}\n");
+        fflush(f);
+        if (ferror(f))
+                fprintf(stderr, "Warning: I/O error while writing trace file '%s'\n", traceFilepath);
+        fclose(f);
+        if (numDropped)
+                fprintf(stderr, "Warning: %llu trace events dropped, the buffers were full\n",
+                        (unsigned long long) numDropped);
+}
+
+void start_tracing(const char *filepath)
+{
+        const char *env = getenv("SEGMENTS_TRACE_FILE");
+        traceFilepath = env != NULL ? env : filepath;
+        traceStartNs = get_time_ns();
+        atexit(write_trace);
+}
+
+#endif
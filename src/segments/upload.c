@@ -0,0 +1,265 @@
+#include <segments/defs.h>
+#include <segments/logging.h>
+#include <segments/memory.h>
+#include <segments/trace.h>
+#include <segments/upload.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+static SRWLOCK uploadLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE uploadCondition = CONDITION_VARIABLE_INIT;
+
+static void lock_uploads(void) { AcquireSRWLockExclusive(&uploadLock); }
+static void unlock_uploads(void) { ReleaseSRWLockExclusive(&uploadLock); }
+static void wait_for_uploads(void) { SleepConditionVariableSRW(&uploadCondition, &uploadLock, INFINITE, 0); }
+static void signal_uploads(void) { WakeConditionVariable(&uploadCondition); }
+
+static HANDLE uploadThread;
+
+static DWORD WINAPI upload_thread(LPVOID arg);
+
+static int start_upload_thread(void)
+{
+        uploadThread = CreateThread(NULL, 0, upload_thread, NULL, 0, NULL);
+        return uploadThread != NULL;
+}
+
+static void join_upload_thread(void)
+{
+        WaitForSingleObject(uploadThread, INFINITE);
+        CloseHandle(uploadThread);
+}
+#else
+#include <pthread.h>
+
+static pthread_mutex_t uploadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadCondition = PTHREAD_COND_INITIALIZER;
+
+static void lock_uploads(void) { pthread_mutex_lock(&uploadMutex); }
+static void unlock_uploads(void) { pthread_mutex_unlock(&uploadMutex); }
+static void wait_for_uploads(void) { pthread_cond_wait(&uploadCondition, &uploadMutex); }
+static void signal_uploads(void) { pthread_cond_signal(&uploadCondition); }
+
+static pthread_t uploadThread;
+
+static void *upload_thread(void *arg);
+
+static int start_upload_thread(void)
+{
+        return pthread_create(&uploadThread, NULL, upload_thread, NULL) == 0;
+}
+
+static void join_upload_thread(void)
+{
+        pthread_join(uploadThread, NULL);
+}
+#endif
+
+enum {
+        MAX_UPLOADS = 8,
+        UPLOAD_CHUNK_SIZE = 4 << 20,
+};
+
+enum {
+        UPLOAD_FREE,
+        UPLOAD_QUEUED,  // waiting for the worker
+        UPLOAD_DONE,  // commands sent, waiting for the fence
+};
+
+/* The state and the queue are protected by the lock. The rest of an upload
+belongs to the main thread while it is free or done, and to the worker after
+it is taken from the queue. */
+struct Upload {
+        int state;
+        GLuint oldBuffer;
+        size_t keepSize;
+        void *data;
+        size_t size;
+        GLuint buffer;
+        GLsync fence;
+};
+
+static struct Upload uploads[MAX_UPLOADS];
+static int uploadQueue[MAX_UPLOADS];
+static int queueStart;
+static int queueLength;
+static int workerFailed;
+static int workerIsStopping;
+
+static void do_upload(struct Upload *upload)
+{
+        TRACE_SCOPE("async upload");
+        glGenBuffers(1, &upload->buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, upload->buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, upload->keepSize + upload->size, NULL, GL_STATIC_DRAW);
+        if (upload->keepSize > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, upload->oldBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, upload->keepSize);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        for (size_t offset = 0; offset < upload->size; offset += UPLOAD_CHUNK_SIZE) {
+                size_t size = upload->size - offset;
+                if (size > UPLOAD_CHUNK_SIZE)
+                        size = UPLOAD_CHUNK_SIZE;
+                glBufferSubData(GL_COPY_WRITE_BUFFER, upload->keepSize + offset, size,
+                                (const char *) upload->data + offset);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+                LOG_WARNING(LOGCATEGORY_GFX, "Upload of %zu bytes failed with GL error 0x%x",
+                            upload->keepSize + upload->size, err);
+                glDeleteBuffers(1, &upload->buffer);
+                upload->buffer = 0;
+                upload->fence = NULL;
+        }
+        else if ((upload->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)) == NULL)
+                glFinish();
+        // the fence must reach the GPU before the main thread can wait for it
+        glFlush();
+        free_memory(&upload->data);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI upload_thread(LPVOID arg)
+#else
+static void *upload_thread(void *arg)
+#endif
+{
+        (void) arg;
+        int ok = make_upload_context_current();
+        lock_uploads();
+        if (!ok) {
+                workerFailed = 1;
+                unlock_uploads();
+                LOG_WARNING(LOGCATEGORY_GL, "Failed to make the upload context current");
+                return 0;
+        }
+        for (;;) {
+                while (queueLength == 0 && !workerIsStopping)
+                        wait_for_uploads();
+                if (workerIsStopping)
+                        break;
+                struct Upload *upload = &uploads[uploadQueue[queueStart]];
+                queueStart = (queueStart + 1) % MAX_UPLOADS;
+                queueLength--;
+                unlock_uploads();
+                do_upload(upload);
+                lock_uploads();
+                upload->state = UPLOAD_DONE;
+        }
+        unlock_uploads();
+        // the context must not be current anywhere when it gets destroyed
+        release_upload_context();
+        return 0;
+}
+
+int start_upload_worker(void)
+{
+        const char *env = getenv("SEGMENTS_UPLOAD_WORKER");
+        if (env != NULL && !strcmp(env, "0"))
+                return 0;
+        if (!have_gl_extension("GL_ARB_sync") || !have_gl_extension("GL_ARB_copy_buffer")) {
+                LOG_INFO(LOGCATEGORY_GL, "GL_ARB_sync or GL_ARB_copy_buffer is not supported, uploading on the main thread");
+                return 0;
+        }
+        if (!create_upload_context()) {
+                LOG_WARNING(LOGCATEGORY_GL, "Failed to create the upload context, uploading on the main thread");
+                return 0;
+        }
+        if (!start_upload_thread()) {
+                LOG_WARNING(LOGCATEGORY_GENERAL, "Failed to start the upload thread, uploading on the main thread");
+                return 0;
+        }
+        return 1;
+}
+
+int start_upload(GLuint oldBuffer, size_t keepSize, void *data, size_t size)
+{
+        lock_uploads();
+        int id = 0;
+        while (id < MAX_UPLOADS && uploads[id].state != UPLOAD_FREE)
+                id++;
+        if (id == MAX_UPLOADS || workerFailed) {
+                unlock_uploads();
+                free_memory(&data);
+                return -1;
+        }
+        struct Upload *upload = &uploads[id];
+        upload->state = UPLOAD_QUEUED;
+        upload->oldBuffer = oldBuffer;
+        upload->keepSize = keepSize;
+        upload->data = data;
+        upload->size = size;
+        uploadQueue[(queueStart + queueLength) % MAX_UPLOADS] = id;
+        queueLength++;
+        signal_uploads();
+        unlock_uploads();
+        return id;
+}
+
+int has_upload_worker_failed(void)
+{
+        lock_uploads();
+        int failed = workerFailed;
+        unlock_uploads();
+        return failed;
+}
+
+void stop_upload_worker(void)
+{
+        lock_uploads();
+        workerIsStopping = 1;
+        signal_uploads();
+        unlock_uploads();
+        join_upload_thread();
+        // the worker is gone, so everything belongs to the main thread now
+        for (int i = 0; i < MAX_UPLOADS; i++) {
+                struct Upload *upload = &uploads[i];
+                if (upload->state == UPLOAD_QUEUED)
+                        free_memory(&upload->data);
+                else if (upload->state == UPLOAD_DONE) {
+                        if (upload->fence != NULL)
+                                glDeleteSync(upload->fence);
+                        glDeleteBuffers(1, &upload->buffer);
+                }
+                upload->state = UPLOAD_FREE;
+        }
+        queueLength = 0;
+        workerFailed = 1;
+}
+
+int poll_upload(int uploadId, GLuint *buffer)
+{
+        struct Upload *upload = &uploads[uploadId];
+        lock_uploads();
+        if (upload->state == UPLOAD_QUEUED && workerFailed) {
+                // the worker is gone before it could take it
+                upload->state = UPLOAD_FREE;
+                unlock_uploads();
+                free_memory(&upload->data);
+                *buffer = 0;
+                return 1;
+        }
+        int isDone = upload->state == UPLOAD_DONE;
+        unlock_uploads();
+        if (!isDone)
+                return 0;
+        if (upload->fence != NULL) {
+                GLenum status = glClientWaitSync(upload->fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                        return 0;
+                glDeleteSync(upload->fence);
+                if (status == GL_WAIT_FAILED) {
+                        LOG_WARNING(LOGCATEGORY_GL, "Waiting for an upload failed");
+                        glDeleteBuffers(1, &upload->buffer);
+                        upload->buffer = 0;
+                }
+        }
+        *buffer = upload->buffer;
+        lock_uploads();
+        upload->state = UPLOAD_FREE;
+        unlock_uploads();
+        return 1;
+}
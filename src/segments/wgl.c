@@ -1,6 +1,7 @@
 #include <segments/defs.h>
 #include <segments/logging.h>
 #include <segments/opengl.h>
+#include <segments/trace.h>
 #include <segments/window.h>
 #include <assert.h>
 #include <Windows.h>
@@ -22,6 +23,9 @@ static const struct {
         { VK_UP, KEY_UP },
         { VK_DOWN, KEY_DOWN },
         { VK_SPACE, KEY_SPACE },
+        { VK_F1, KEY_F1 },
+        { VK_F2, KEY_F2 },
+        { VK_F3, KEY_F3 },
 };
 
 static const struct {
@@ -36,6 +40,17 @@ static const struct {
 static HWND globalWND;
 static HDC globalDC;
 static HGLRC globalGLRC;
+static int globalPixelFormat;
+static HWND uploadWND;  // hidden, the upload context needs a drawable
+static HDC uploadDC;
+static HGLRC uploadGLRC;
+
+static const int gl33_attribs[] = {
+    WGL_CONTEXT_MAJOR_VERSION_ARB, 3,
+    WGL_CONTEXT_MINOR_VERSION_ARB, 3,
+    WGL_CONTEXT_PROFILE_MASK_ARB,  WGL_CONTEXT_CORE_PROFILE_BIT_ARB,
+    0,
+};
 
 LRESULT CALLBACK my_window_proc(
     _In_ HWND hWnd,
@@ -209,42 +224,26 @@ void create_opengl_context(void)
         FIND AND SET PIXEL FORMAT
         */
 
-        int trysamplesettings[] = {
-                16, 4, 1
+        // no MSAA, that is done in an offscreen framebuffer (see gfx.c)
+        const float pfAttribFList[] = { 0, 0 };
+        const int piAttribIList[] = {
+            WGL_DRAW_TO_WINDOW_ARB, GL_TRUE,
+            WGL_SUPPORT_OPENGL_ARB, GL_TRUE,
+            WGL_COLOR_BITS_ARB, 32,
+            WGL_RED_BITS_ARB, 8,
+            WGL_GREEN_BITS_ARB, 8,
+            WGL_BLUE_BITS_ARB, 8,
+            WGL_ALPHA_BITS_ARB, 8,
+            WGL_DEPTH_BITS_ARB, 16,
+            WGL_STENCIL_BITS_ARB, 0,
+            WGL_DOUBLE_BUFFER_ARB, GL_TRUE,
+            WGL_PIXEL_TYPE_ARB, WGL_TYPE_RGBA_ARB,
+            0, 0
         };
         int pixelFormat;
-        int foundPixelFormat = 0;
-
-        for (int i = 0; i < LENGTH(trysamplesettings); i++) {
-                int numSamples = trysamplesettings[i];
-                const float pfAttribFList[] = { 0, 0 };
-                const int piAttribIList[] = {
-                    WGL_DRAW_TO_WINDOW_ARB, GL_TRUE,
-                    WGL_SUPPORT_OPENGL_ARB, GL_TRUE,
-                    WGL_COLOR_BITS_ARB, 32,
-                    WGL_RED_BITS_ARB, 8,
-                    WGL_GREEN_BITS_ARB, 8,
-                    WGL_BLUE_BITS_ARB, 8,
-                    WGL_ALPHA_BITS_ARB, 8,
-                    WGL_DEPTH_BITS_ARB, 16,
-                    WGL_STENCIL_BITS_ARB, 0,
-                    WGL_DOUBLE_BUFFER_ARB, GL_TRUE,
-                    WGL_PIXEL_TYPE_ARB, WGL_TYPE_RGBA_ARB,
-                    // suppport for MSAA. Is 16 too much? It works for me.
-                    WGL_SAMPLE_BUFFERS_ARB, GL_TRUE,
-                    WGL_SAMPLES_ARB, numSamples,
-                    0, 0
-                };
-
-                UINT nMaxFormats = 1;
-                UINT nNumFormats;
-                if (!wglChoosePixelFormatARB(globalDC, piAttribIList, pfAttribFList, nMaxFormats, &pixelFormat, &nNumFormats))
-                        continue;
-                foundPixelFormat = 1;
-                break;
-        }
-
-        if (!foundPixelFormat)
+        UINT nNumFormats;
+        if (!wglChoosePixelFormatARB(globalDC, piAttribIList, pfAttribFList, 1, &pixelFormat, &nNumFormats)
+            || nNumFormats == 0)
                 fatal_f("Failed to ChoosePixelFormat()");
 
         /* Passing NULL as the PIXELFORMATDESCRIPTOR pointer. Does that work on all machines?
@@ -255,24 +254,59 @@ void create_opengl_context(void)
         if (!SetPixelFormat(globalDC, pixelFormat, NULL))
                 fatal_f("failed to SetPixelFormat()");
 
+        globalPixelFormat = pixelFormat;
+
         /* create opengl context */
-        static const int gl30_attribs[] = {
-            WGL_CONTEXT_MAJOR_VERSION_ARB, 3,
-            WGL_CONTEXT_MINOR_VERSION_ARB, 0,
-            WGL_CONTEXT_PROFILE_MASK_ARB,  WGL_CONTEXT_CORE_PROFILE_BIT_ARB,
-            0,
-        };
-        globalGLRC = wglCreateContextAttribsARB(globalDC, 0, gl30_attribs);
+        globalGLRC = wglCreateContextAttribsARB(globalDC, 0, gl33_attribs);
         if (!globalGLRC)
-                fatal_f("Failed to create OpenGL 3.0 context.");
+                fatal_f("Failed to create OpenGL 3.3 core context.");
 
         if (!wglMakeCurrent(globalDC, globalGLRC))
                 fatal_f("Failed to wglMakeCurrent(globalDC, globalGLRC);");
 }
 
+int create_upload_context(void)
+{
+        // its own class, my_window_proc() must not see its messages
+        WNDCLASSA wc = {0};
+        wc.lpfnWndProc = DefWindowProcA;
+        wc.hInstance = GetModuleHandle(NULL);
+        wc.lpszClassName = "uploadclass";
+        wc.style = CS_OWNDC;
+        if (!RegisterClassA(&wc))
+                return 0;
+        uploadWND = CreateWindowA(wc.lpszClassName, "upload", 0, 0, 0, 1, 1, NULL, NULL, wc.hInstance, NULL);
+        if (uploadWND == NULL)
+                return 0;
+        uploadDC = GetDC(uploadWND);
+        if (uploadDC == NULL || !SetPixelFormat(uploadDC, globalPixelFormat, NULL))
+                return 0;
+        uploadGLRC = wglCreateContextAttribsARB(uploadDC, globalGLRC, gl33_attribs);
+        return uploadGLRC != NULL;
+}
+
+int make_upload_context_current(void)
+{
+        return wglMakeCurrent(uploadDC, uploadGLRC);
+}
+
+void release_upload_context(void)
+{
+        wglMakeCurrent(NULL, NULL);
+}
+
 void close_window(void)
 {
-        // TODO
+        // released by the worker in stop_upload_worker()
+        if (uploadGLRC != NULL)
+                wglDeleteContext(uploadGLRC);
+        if (uploadWND != NULL) {
+                if (uploadDC != NULL)
+                        ReleaseDC(uploadWND, uploadDC);
+                DestroyWindow(uploadWND);
+        }
+        UnregisterClassA("uploadclass", GetModuleHandle(NULL));
+        // TODO: the main window
 }
 
 void *load_opengl_pointer(const char *name)
@@ -282,6 +316,7 @@ void *load_opengl_pointer(const char *name)
 
 void fetch_all_pending_events(void)
 {
+        TRACE_SCOPE("fetch_all_pending_events");
         MSG msg;
         BOOL bRet;
         for (;;) {
@@ -293,8 +328,25 @@ void fetch_all_pending_events(void)
         }
 }
 
+int query_mouse_position(int *x, int *y)
+{
+        POINT point;
+        if (!GetCursorPos(&point) || !ScreenToClient(globalWND, &point))
+                return 0;
+        *x = point.x;
+        *y = point.y;
+        return 1;
+}
+
 void swap_buffers(void)
 {
+        TRACE_SCOPE("swap_buffers");
         if (!SwapBuffers(globalDC))
                 fatal_f("Failed to SwapBuffers()");
+}
+
+int get_back_buffer_age(void)
+{
+        // WGL has no equivalent of GLX_EXT_buffer_age
+        return 0;
 }
\ No newline at end of file
@@ -1,15 +1,25 @@
+#include <segments/clock.h>
 #include <segments/defs.h>
 #include <segments/window.h>
 #include <string.h>
 
 static struct Event queue[16];
 static int numEvents;
+static uint64_t numDroppedEvents;
 
 void send_event(struct Event event)
 {
+        event.timeNs = get_time_ns();
         if (numEvents < sizeof queue / sizeof queue[0]) {
                 queue[numEvents++] = event;
         }
+        else
+                numDroppedEvents++;
+}
+
+uint64_t get_number_of_dropped_events(void)
+{
+        return numDroppedEvents;
 }
 
 void send_key_event(int keyKind)